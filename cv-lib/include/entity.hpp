@@ -148,6 +148,11 @@ struct Point {
     friend std::ostream& operator<<(std::ostream& os, const Point& pt);
 };
 
+/**
+ * @brief The kinds of entities; dispatching on the kind avoids building and comparing the #Entity::get_type strings.
+ */
+enum class EntityKind : uint8_t { LOCATION, EDGE, AREA, CORRIDOR, CIRCLE, GRID };
+
 /**
  * @brief Interface for entities which can be partially contained within other
  * entities. Entity is the base class for all shapes, points, lines, etc.
@@ -166,6 +171,13 @@ class Entity {
          */ 
         virtual const std::string get_type(void) const = 0;
 
+        /**
+         * @brief Get the kind of this entity; the tag form of #get_type.
+         * 
+         * @return the kind of this entity.
+         */ 
+        virtual EntityKind get_kind(void) const = 0;
+
         /**
          * @brief Determine is this entity is within the bounds object.
          * 
@@ -356,6 +368,13 @@ class Location : public Point, public Entity {
          */ 
         const std::string get_type(void) const;
 
+        /**
+         * Get the kind of this entity.
+         * 
+         * @return the kind of this entity.
+         */ 
+        EntityKind get_kind(void) const;
+
         /**
          * @brief Determine is this location is within the bounds object.
          * 
@@ -663,6 +682,13 @@ class Edge : public Entity {
          */ 
         const std::string get_type(void) const;
 
+        /**
+         * Get the kind of this entity.
+         * 
+         * @return the kind of this entity.
+         */ 
+        EntityKind get_kind(void) const;
+
         /**
          * Determine if this edge is within the bounds object.
          * 
@@ -914,6 +940,13 @@ class Area : public Entity {
          */ 
         const std::string get_type(void) const;
 
+        /**
+         * Get the kind of this entity.
+         * 
+         * @return the kind of this entity.
+         */ 
+        EntityKind get_kind(void) const;
+
         /**
          * @brief Predicate that indicates whether this area is contained within the 
          * provided bounds or intersects spatially the bounds.
@@ -984,6 +1017,78 @@ class Area : public Entity {
         friend std::ostream& operator<< ( std::ostream& os, const Area& area );
 };
 
+/**
+ * @brief An edge together with its extended area: the area around the edge, lengthened at both ends, that a point
+ * must be within to be near the edge. The area is computed once, when the map is loaded, instead of for every point
+ * that is checked against the edge.
+ *
+ * A corridor touches exactly the bounds its edge touches, so it is placed in a Quad where its edge would be.
+ */
+class Corridor : public Entity {
+    public:
+        using Ptr = std::shared_ptr<Corridor>;              ///< Shared pointer to a Corridor.
+        using CPtr = std::shared_ptr<const Corridor>;       ///< Shared pointer to a constant Corridor.
+
+        /**
+         * @brief Construct the corridor of an edge.
+         *
+         * @param edge the edge; its way type determines the width of the area.
+         * @param extension the meters to extend the area from each end of the edge.
+         * @throws ZeroAreaException when the area characterizes 0 space.
+         */
+        Corridor( const EdgeCPtr& edge, double extension );
+
+        /**
+         * Get a string that identifies the type of this entity.
+         * 
+         * @return std::string The type of this enitity.
+         */ 
+        const std::string get_type(void) const;
+
+        /**
+         * Get the kind of this entity.
+         * 
+         * @return the kind of this entity.
+         */ 
+        EntityKind get_kind(void) const;
+
+        /**
+         * @brief Predicate that indicates whether this corridor's edge touches the provided bounds.
+         *
+         * @param bounds the bounds to test against.
+         * @return true if the edge touches the bounds; false otherwise.
+         */
+        bool touches(const Bounds& bounds) const;
+
+        /**
+         * @brief Predicate that indicates whether the extended area contains the provided point.
+         *
+         * @param pt the point whose containment is checked.
+         * @return true if the point is within the area; false otherwise.
+         */
+        bool contains( const Point& pt ) const;
+
+        /**
+         * @brief Return the edge of this corridor.
+         */
+        const EdgeCPtr& get_edge() const;
+
+        /**
+         * @brief Return the extended area of this corridor.
+         */
+        const Area& get_area() const;
+
+        /**
+         * @brief Return the meters the area extends from each end of the edge.
+         */
+        double get_extension() const;
+
+    private:
+        EdgeCPtr edge_;                             ///< The edge.
+        double extension_;                          ///< The meters the area extends from each end of the edge.
+        Area area_;                                 ///< The extended area around the edge.
+};
+
 /**
  * @brief A circle is a 2D GPS coordinate and a radius measured in meters. The
  * circle is also described by its northernmost, southernmost, easternmost,
@@ -1041,6 +1146,13 @@ class Circle : public Location {
          */ 
         const std::string get_type(void) const;
 
+        /**
+         * Get the kind of this entity.
+         * 
+         * @return the kind of this entity.
+         */ 
+        EntityKind get_kind(void) const;
+
         /**
          * Predicate indicating whether this circle is within the provided
          * bounds.
@@ -1297,6 +1409,13 @@ class Grid : public Bounds, public Entity {
          */ 
         const std::string get_type(void) const;
 
+        /**
+         * Get the kind of this entity.
+         * 
+         * @return the kind of this entity.
+         */ 
+        EntityKind get_kind(void) const;
+
         /**
          * @brief Predicate indicating whether any of the corners of this grid are within
          * the provided bounds, the grid is contained in the bounds, or the bounds is contained in the grid.
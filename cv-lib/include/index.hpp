@@ -0,0 +1,258 @@
+/** 
+ * @file 
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *    Oak Ridge National Laboratory, Center for Trustworthy Embedded Systems, UT Battelle.
+ */
+
+#ifndef CVDP_INDEX_HPP
+#define CVDP_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "entity.hpp"
+#include "kernels.hpp"
+
+/**
+ * @brief The read-only lookup side of a geofence: a set of cells, each with the entities a point in it must be tested
+ * against. Implementations differ only in how a point is located in a cell; the cell contents are stored here the same
+ * way for all of them. Each cell is a slice of one packed array of entity indices, a slice of the entities that are not
+ * corridors, and a padded block of corridor areas tested together by a geo::kernel::AreaArrays kernel.
+ */
+class SpatialIndex {
+    public:
+        using Point  = geo::Point;
+        using Entity = geo::Entity;
+
+        using CPtr = std::shared_ptr<const SpatialIndex>;
+
+        constexpr static std::size_t npos = static_cast<std::size_t>( -1 );   ///< Returned by locate for a point in no cell.
+
+        /**
+         * @brief The entities of one cell; a range over the packed indices that dereferences to the entities.
+         */
+        class ElementRange {
+            public:
+                class const_iterator {
+                    public:
+                        const_iterator( const uint32_t* index, const Entity::CPtr* entities ) :
+                            index_{ index },
+                            entities_{ entities }
+                        {}
+
+                        const Entity& operator*() const { return *entities_[ *index_ ]; }
+                        const Entity* operator->() const { return entities_[ *index_ ].get(); }
+                        const_iterator& operator++() { ++index_; return *this; }
+                        bool operator==( const const_iterator& other ) const { return index_ == other.index_; }
+                        bool operator!=( const const_iterator& other ) const { return index_ != other.index_; }
+
+                    private:
+                        const uint32_t* index_;                         ///< The current position in the packed indices.
+                        const Entity::CPtr* entities_;                  ///< The entities the indices refer to.
+                };
+
+                ElementRange( const uint32_t* first, const uint32_t* last, const Entity::CPtr* entities ) :
+                    first_{ first },
+                    last_{ last },
+                    entities_{ entities }
+                {}
+
+                const_iterator begin() const { return const_iterator{ first_, entities_ }; }
+                const_iterator end() const { return const_iterator{ last_, entities_ }; }
+                std::size_t size() const { return static_cast<std::size_t>( last_ - first_ ); }
+                bool empty() const { return first_ == last_; }
+
+            private:
+                const uint32_t* first_;
+                const uint32_t* last_;
+                const Entity::CPtr* entities_;
+        };
+
+        virtual ~SpatialIndex() = default;
+
+        /**
+         * @brief Return the cell that contains the provided point.
+         *
+         * @param pt The point whose cell we are interested in.
+         * @return the index of the cell; npos when no cell contains the point.
+         */
+        virtual std::size_t locate( const Point& pt ) const = 0;
+
+        /**
+         * @brief Return the name of the implementation, as used in the configuration.
+         */
+        virtual const char* name() const = 0;
+
+        /**
+         * @brief Return the number of bytes a lookup may read.
+         */
+        virtual std::size_t footprint() const;
+
+        /**
+         * @brief Return the entities in the cell that contains the provided point.
+         *
+         * @param pt The point whose cell we are interested in.
+         * @return the cell's entities; empty when no cell contains the point.
+         */
+        ElementRange retrieve_elements( const Point& pt ) const;
+
+        /**
+         * @brief Return all the entities of a cell.
+         *
+         * @param cell a cell index returned by locate; npos gives an empty range.
+         */
+        ElementRange elements( std::size_t cell ) const;
+
+        /**
+         * @brief Return the entities of a cell that are not corridors; those are tested by corridors_contain.
+         *
+         * @param cell a cell index returned by locate; npos gives an empty range.
+         */
+        ElementRange others( std::size_t cell ) const;
+
+        /**
+         * @brief Predicate indicating whether the area of any corridor in a cell contains a point.
+         *
+         * @param cell a cell index returned by locate; npos gives false.
+         * @param pt the point to test.
+         * @return true if at least one corridor area in the cell contains the point.
+         */
+        bool corridors_contain( std::size_t cell, const Point& pt ) const;
+
+        /**
+         * @brief Test many points against the corridor areas of one cell; the points need not lie in the cell.
+         *
+         * @param cell a cell index returned by locate.
+         * @param lat the latitudes of the points.
+         * @param lon the longitudes of the points.
+         * @param n the number of points.
+         * @param out set to true for each point that at least one corridor area in the cell contains; false otherwise.
+         */
+        void corridors_contain( std::size_t cell, const double* lat, const double* lon, std::size_t n, bool* out ) const;
+
+        /**
+         * @brief Return the extension every corridor in the index was built with; NaN if there are none or they differ.
+         */
+        double corridor_extension() const;
+
+        /**
+         * @brief Return the instruction set the corridor tests use.
+         */
+        geo::kernel::Isa isa() const;
+
+        /**
+         * @brief Return the number of cells.
+         */
+        std::size_t cell_count() const;
+
+        /**
+         * @brief Return the number of distinct entities; an entity in several cells is counted once.
+         */
+        std::size_t entity_count() const;
+
+    protected:
+        /**
+         * @brief Construct an index with no cells.
+         *
+         * @param isa the kernel the corridor tests use.
+         */
+        explicit SpatialIndex( geo::kernel::Isa isa );
+
+        /**
+         * @brief Append a cell holding the given entities, in order.
+         *
+         * @return the index of the new cell.
+         */
+        std::size_t add_cell( const Entity::PtrList& entities );
+
+    private:
+        /**
+         * @brief The slices of one cell.
+         */
+        struct Cell {
+            uint32_t first;                                     ///< The cell's first entity index.
+            uint32_t count;
+            uint32_t others_first;                              ///< The first index of the entities that are not corridors.
+            uint32_t others_count;
+            uint32_t areas_first;                               ///< The cell's first corridor area in areas_.
+            uint32_t areas_count;                               ///< The number of corridor areas, not counting the padding.
+        };
+
+        std::vector<Cell> cells_;                               ///< The cells, in the order they were added.
+        std::vector<uint32_t> indices_;                         ///< The cell slices of indices into entities_.
+        std::vector<Entity::CPtr> entities_;                    ///< Each distinct entity once; keeps them alive.
+        std::unordered_map<const Entity*, uint32_t> entity_index_;     ///< Finds an entity already in entities_; used while building.
+        geo::kernel::AreaArrays areas_;                         ///< The corridor areas of each cell in a padded block.
+        double corridor_extension_;                             ///< The extension shared by all the corridors; NaN otherwise.
+        bool has_corridor_;                                     ///< True once a corridor has been added.
+        geo::kernel::Isa isa_;                                  ///< The kernel the corridor tests use.
+};
+
+/**
+ * @brief A spatial index on a uniform grid of square lat/lon cells. Only the cells that hold entities are stored, in a
+ * hash from cell id to cell, so locating a point is a little arithmetic and one hash lookup regardless of how the
+ * entities are distributed. An entity is placed in every cell it touches when the cell is extended on each side by a
+ * tenth of its size, as a Quad extends its leaves, but never by less than the smallest Quad leaf is extended. Corridors
+ * are placed by their areas rather than their edges.
+ */
+class GridIndex : public SpatialIndex {
+    public:
+        constexpr static double kDefaultCellDegrees = 0.005;    ///< The default cell size in degrees; about 550 meters of latitude.
+        constexpr static double REDUCTION_FACTOR = 10.0;        ///< The cell size divided by this is the margin used to place entities.
+        constexpr static double MIN_MARGIN_DEGREES = 0.0003;    ///< The smallest margin; that of a Quad leaf of Quad::MIN_DEGREES.
+
+        /**
+         * @brief Build a grid over a region.
+         *
+         * @param sw the southwest corner of the region.
+         * @param ne the northeast corner of the region.
+         * @param cell_degrees the width and height of a cell in degrees.
+         * @param entities the entities to place; those outside the region are left out.
+         * @param isa the kernel the corridor tests use; defaults to the widest this CPU supports.
+         * @throws std::invalid_argument if the cell size is not positive or the region is empty.
+         */
+        GridIndex( const Point& sw, const Point& ne, double cell_degrees, const Entity::PtrList& entities, geo::kernel::Isa isa = geo::kernel::supported_isa() );
+
+        std::size_t locate( const Point& pt ) const override;
+        const char* name() const override;
+        std::size_t footprint() const override;
+
+        /**
+         * @brief Return the size of a cell in degrees.
+         */
+        double cell_degrees() const;
+
+    private:
+        /**
+         * @brief Add the ids of the cells in a block of rows and columns that the entity touches; splits the block until
+         * it is a single cell, skipping the parts the entity does not touch.
+         */
+        void touched_cells( const Entity& entity, uint32_t row0, uint32_t col0, uint32_t rows, uint32_t cols, std::vector<uint64_t>& ids ) const;
+
+        Point sw_;                                              ///< The southwest corner of the region.
+        Point ne_;                                              ///< The northeast corner of the region.
+        double cell_degrees_;                                   ///< The width and height of a cell.
+        double inverse_cell_;                                   ///< 1 / cell_degrees_.
+        uint32_t rows_;                                         ///< The number of cells from south to north.
+        uint32_t cols_;                                         ///< The number of cells from west to east.
+        std::unordered_map<uint64_t, uint32_t> cell_ids_;       ///< Cell id (row * cols_ + col) to cell; only cells with entities.
+};
+
+#endif
@@ -0,0 +1,110 @@
+/** 
+ * @file 
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *    Oak Ridge National Laboratory, Center for Trustworthy Embedded Systems, UT Battelle.
+ */
+
+#ifndef CVDP_KERNELS_HPP
+#define CVDP_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "entity.hpp"
+
+namespace geo {
+namespace kernel {
+
+/**
+ * @brief The instruction sets the containment kernels are written for.
+ */
+enum class Isa : uint8_t { SCALAR, AVX };
+
+/**
+ * @brief Return the widest instruction set this CPU supports; detected once.
+ */
+Isa supported_isa();
+
+/**
+ * @brief Return the name of an instruction set: "scalar" or "avx".
+ */
+const char* isa_name( Isa isa );
+
+/**
+ * @brief Areas stored structure-of-arrays so one point can be tested against several areas per instruction. Each area
+ * is kept as the coefficients of its four edge lines, computed as Area::outside_edge computes them, so the kernels give
+ * exactly the answers Area::contains gives. Areas are added in blocks; each block is padded to a multiple of kLanes.
+ */
+class AreaArrays {
+    public:
+        constexpr static std::size_t kLanes = 4;            ///< The number of areas tested together.
+
+        /**
+         * @brief Add an area to the current block.
+         *
+         * @param area the area; only its corners are kept.
+         */
+        void add( const Area& area );
+
+        /**
+         * @brief Close the current block by padding it to a multiple of kLanes.
+         *
+         * @param first the index of the block's first area, i.e., size() before its areas were added.
+         */
+        void pad( std::size_t first );
+
+        /**
+         * @brief Return the number of stored entries, padding included.
+         */
+        std::size_t size() const;
+
+        /**
+         * @brief Predicate indicating whether any area in a block contains a point.
+         *
+         * @param first the index of the block's first area.
+         * @param count the number of areas in the block, not counting the padding.
+         * @param pt the point to test.
+         * @param isa the kernel to use; the scalar kernel is used when the CPU lacks the instruction set.
+         * @return true if at least one of the areas contains the point.
+         */
+        bool any_contains( std::size_t first, std::size_t count, const Point& pt, Isa isa = supported_isa() ) const;
+
+        /**
+         * @brief Test many points against the areas of one block.
+         *
+         * @param first the index of the block's first area.
+         * @param count the number of areas in the block, not counting the padding.
+         * @param lat the latitudes of the points.
+         * @param lon the longitudes of the points.
+         * @param n the number of points.
+         * @param out set to true for each point that at least one of the areas contains; false otherwise.
+         * @param isa the kernel to use; the scalar kernel is used when the CPU lacks the instruction set.
+         */
+        void any_contains( std::size_t first, std::size_t count, const double* lat, const double* lon, std::size_t n, bool* out, Isa isa = supported_isa() ) const;
+
+    private:
+        // for edge k of an area, from corner k to corner k+1: D = -lat * dlon + lon * dlat + c, and D < 0 is outside.
+        std::vector<double> dlat_[4];                       ///< The latitude change along each edge.
+        std::vector<double> dlon_[4];                       ///< The longitude change along each edge.
+        std::vector<double> c_[4];                          ///< The constant term of each edge line.
+};
+
+} // namespace kernel
+} // namespace geo
+
+#endif
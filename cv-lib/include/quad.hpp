@@ -31,9 +31,12 @@
 #include <sstream>
 #include <stack>
 #include <memory>
+#include <vector>
+#include <cstdint>
 
 #include "names.hpp"
 #include "entity.hpp"
+#include "index.hpp"
 #include "osm.hpp"
 
 /**
@@ -142,6 +145,8 @@ class Quad : public geo::Bounds {
         friend std::ostream& operator<< (std::ostream& os, const Quad& quad);
 
     private:
+        friend class FrozenQuad;                                ///< Reads the tree when flattening it.
+
         static geo::Vertex::IdToPtrMap elementmap;              ///< Lookup table from vertex unique identifer to pointers to Vertex instance; prevents duplicating Vertex creation.
         static geo::Entity::PtrList empty_element_list;                ///< Fixed empty set of Edges; returned when a point is contained in a Quad with no Entities.
 
@@ -189,4 +194,60 @@ class Quad : public geo::Bounds {
         bool split( );
 };
 
+/**
+ * @brief A read-only copy of a Quad tree laid out for lookups. The nodes are stored in one array and refer to each other
+ * by index; the children of a node are adjacent and every node holds its retrieval bounds inline. Each leaf is a cell
+ * of the SpatialIndex, so its entities are a slice of one packed array of indices and its corridor areas are tested
+ * together. A descent therefore reads a few contiguous nodes instead of following shared pointers across the heap. The
+ * Quad remains the builder: insert all the entities and then freeze it.
+ */
+class FrozenQuad : public SpatialIndex {
+    public:
+        using CPtr = std::shared_ptr<const FrozenQuad>;
+
+        /**
+         * @brief Flatten a Quad tree; later inserts into the Quad are not seen by this copy.
+         *
+         * @param root the root of the tree to flatten.
+         * @param isa the kernel the corridor tests use; defaults to the widest this CPU supports.
+         */
+        explicit FrozenQuad( const Quad& root, geo::kernel::Isa isa = geo::kernel::supported_isa() );
+
+        /**
+         * @brief Return the leaf that contains the provided point; its entities are the same, in the same order, as those
+         * Quad::retrieve_elements returns.
+         *
+         * @param pt The point whose containing leaf we are interested in.
+         * @return the index of the leaf's cell; npos when the point is outside the tree.
+         */
+        std::size_t locate( const Point& pt ) const override;
+
+        const char* name() const override;
+        std::size_t footprint() const override;
+
+        /**
+         * @brief Return the number of nodes in the tree.
+         */
+        std::size_t node_count() const;
+
+    private:
+        /**
+         * @brief A tree node. Interior nodes refer to their adjacent children; leaves to their cell.
+         */
+        struct Node {
+            double sw_lat;                                      ///< The retrieval bounds of the node.
+            double sw_lon;
+            double ne_lat;
+            double ne_lon;
+            uint32_t first;                                     ///< The first child node, or the cell of a leaf.
+            uint32_t count;                                     ///< The number of children; 0 for a leaf.
+
+            bool contains( const Point& pt ) const {
+                return sw_lat <= pt.lat && pt.lat <= ne_lat && sw_lon <= pt.lon && pt.lon <= ne_lon;
+            }
+        };
+
+        std::vector<Node> nodes_;                               ///< The nodes in breadth-first order; the root is first.
+};
+
 #endif
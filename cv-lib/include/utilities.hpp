@@ -173,6 +173,30 @@ namespace double_utilities {
  */
  bool are_equal(double a, double b, double epsilon);
 
+/**
+ * @brief Convert a number, e.g., a coordinate or a speed, to a double without a copy and without the locale. A plain
+ * decimal with at most 15 significant digits is converted directly, and exactly: the digits and the power of ten are
+ * both exact doubles, so their quotient is the correctly rounded value, the same as strtod. Any other number, e.g.,
+ * one with an exponent, is converted by strtod_l in the "C" locale.
+ *
+ * @param str the start of the number; it need not be null terminated.
+ * @param length the number of characters in the number.
+ * @param value the converted number; unchanged if the conversion fails.
+ * @return true if all the characters are the number and it is within the range of a double; false otherwise.
+ */
+bool to_double(const char* str, std::size_t length, double& value);
+
+/**
+ * @brief Convert a string to a double like std::stod, but without the locale, using the direct conversion when the
+ * string is a number.
+ *
+ * @param s the string to convert.
+ * @return the converted number.
+ * @throws std::invalid_argument if no conversion can be performed.
+ * @throws std::out_of_range if the number is out of the range of a double.
+ */
+double to_double(const std::string& s);
+
 }  // end namespace.
 
 #endif
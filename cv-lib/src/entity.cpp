@@ -166,6 +166,10 @@ const std::string Location::get_type() const {
     return "location";
 }
 
+EntityKind Location::get_kind() const {
+    return EntityKind::LOCATION;
+}
+
 bool Location::touches(const Bounds& bounds) const {
     return bounds.contains(*this); 
 }
@@ -290,6 +294,10 @@ const std::string Edge::get_type(void) const {
     return "edge";
 }
 
+EntityKind Edge::get_kind() const {
+    return EntityKind::EDGE;
+}
+
 bool Edge::touches(const Bounds& bounds) const {
     return bounds.contains_or_intersects(*this);
 }
@@ -483,6 +491,10 @@ const std::string Area::get_type() const {
     return "area";
 }
 
+EntityKind Area::get_kind() const {
+    return EntityKind::AREA;
+}
+
 bool Area::touches(const Bounds& bounds) const {
     if (bounds.contains(corners_[0]) || bounds.contains(corners_[1]) || bounds.contains(corners_[2]) || bounds.contains(corners_[3])) {
         return true;
@@ -550,6 +562,40 @@ const std::string Area::get_poly_string() const
     return ss.str();
 }
 
+Corridor::Corridor( const EdgeCPtr& edge, double extension ) :
+    edge_{ edge },
+    extension_{ extension },
+    area_{ *edge->to_area( extension ) }
+{}
+
+const std::string Corridor::get_type() const {
+    return "corridor";
+}
+
+EntityKind Corridor::get_kind() const {
+    return EntityKind::CORRIDOR;
+}
+
+bool Corridor::touches( const Bounds& bounds ) const {
+    return edge_->touches( bounds );
+}
+
+bool Corridor::contains( const Point& pt ) const {
+    return area_.contains( pt );
+}
+
+const EdgeCPtr& Corridor::get_edge() const {
+    return edge_;
+}
+
+const Area& Corridor::get_area() const {
+    return area_;
+}
+
+double Corridor::get_extension() const {
+    return extension_;
+}
+
 Circle::Circle(const Location& location, double radius) :
     Location(location.lat, location.lon, location.uid),
     radius(radius),
@@ -581,6 +627,10 @@ const std::string Circle::get_type(void) const {
     return "circle";
 }
 
+EntityKind Circle::get_kind() const {
+    return EntityKind::CIRCLE;
+}
+
 bool Circle::touches(const Bounds& bounds) const {
     bool cardinals_within_bounds = bounds.contains(north) || bounds.contains(south) || bounds.contains(east) || bounds.contains(west);
 
@@ -714,6 +764,10 @@ Grid::Grid(const geo::Point& sw_loc, const geo::Point& ne_loc, uint32_t row, uin
 const std::string Grid::get_type() const {
     return "grid";
 }
+
+EntityKind Grid::get_kind() const {
+    return EntityKind::GRID;
+}
    
 bool Grid::touches(const geo::Bounds& bounds) const {
     if (bounds.contains(sw) || bounds.contains(ne) || bounds.contains(se) || bounds.contains(nw)) {
@@ -0,0 +1,254 @@
+/** 
+ * @file 
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *    Oak Ridge National Laboratory, Center for Trustworthy Embedded Systems, UT Battelle.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "index.hpp"
+
+constexpr std::size_t SpatialIndex::npos;
+constexpr double GridIndex::kDefaultCellDegrees;
+constexpr double GridIndex::REDUCTION_FACTOR;
+constexpr double GridIndex::MIN_MARGIN_DEGREES;
+
+SpatialIndex::SpatialIndex( geo::kernel::Isa isa ) :
+    corridor_extension_{ std::numeric_limits<double>::quiet_NaN() },
+    has_corridor_{ false },
+    isa_{ isa }
+{}
+
+std::size_t SpatialIndex::add_cell( const Entity::PtrList& entities )
+{
+    Cell cell{ static_cast<uint32_t>( indices_.size() ), static_cast<uint32_t>( entities.size() ), 0, 0, 0, 0 };
+
+    std::vector<uint32_t> others;
+    std::size_t areas_first = areas_.size();
+
+    for ( auto& entity_ptr : entities ) {
+        auto result = entity_index_.emplace( entity_ptr.get(), static_cast<uint32_t>( entities_.size() ) );
+        if ( result.second ) {
+            entities_.push_back( entity_ptr );
+        }
+        indices_.push_back( result.first->second );
+
+        if ( entity_ptr->get_kind() == geo::EntityKind::CORRIDOR ) {
+            const geo::Corridor& corridor = static_cast<const geo::Corridor&>( *entity_ptr );
+            areas_.add( corridor.get_area() );
+
+            if ( !has_corridor_ ) {
+                corridor_extension_ = corridor.get_extension();
+                has_corridor_ = true;
+            } else if ( corridor.get_extension() != corridor_extension_ ) {
+                corridor_extension_ = std::numeric_limits<double>::quiet_NaN();
+            }
+
+        } else {
+            others.push_back( result.first->second );
+        }
+    }
+
+    cell.others_first = static_cast<uint32_t>( indices_.size() );
+    cell.others_count = static_cast<uint32_t>( others.size() );
+    indices_.insert( indices_.end(), others.begin(), others.end() );
+
+    cell.areas_first = static_cast<uint32_t>( areas_first );
+    cell.areas_count = static_cast<uint32_t>( areas_.size() - areas_first );
+    areas_.pad( areas_first );
+
+    cells_.push_back( cell );
+    return cells_.size() - 1;
+}
+
+std::size_t SpatialIndex::footprint() const
+{
+    return cells_.size() * sizeof( Cell ) + indices_.size() * sizeof( uint32_t ) + areas_.size() * 12 * sizeof( double );
+}
+
+SpatialIndex::ElementRange SpatialIndex::retrieve_elements( const Point& pt ) const
+{
+    return elements( locate( pt ) );
+}
+
+SpatialIndex::ElementRange SpatialIndex::elements( std::size_t cell ) const
+{
+    if ( cell == npos ) {
+        return ElementRange{ nullptr, nullptr, nullptr };
+    }
+
+    const uint32_t* first = indices_.data() + cells_[cell].first;
+    return ElementRange{ first, first + cells_[cell].count, entities_.data() };
+}
+
+SpatialIndex::ElementRange SpatialIndex::others( std::size_t cell ) const
+{
+    if ( cell == npos ) {
+        return ElementRange{ nullptr, nullptr, nullptr };
+    }
+
+    const uint32_t* first = indices_.data() + cells_[cell].others_first;
+    return ElementRange{ first, first + cells_[cell].others_count, entities_.data() };
+}
+
+bool SpatialIndex::corridors_contain( std::size_t cell, const Point& pt ) const
+{
+    if ( cell == npos ) {
+        return false;
+    }
+
+    return areas_.any_contains( cells_[cell].areas_first, cells_[cell].areas_count, pt, isa_ );
+}
+
+void SpatialIndex::corridors_contain( std::size_t cell, const double* lat, const double* lon, std::size_t n, bool* out ) const
+{
+    areas_.any_contains( cells_[cell].areas_first, cells_[cell].areas_count, lat, lon, n, out, isa_ );
+}
+
+double SpatialIndex::corridor_extension() const
+{
+    return corridor_extension_;
+}
+
+geo::kernel::Isa SpatialIndex::isa() const
+{
+    return isa_;
+}
+
+std::size_t SpatialIndex::cell_count() const
+{
+    return cells_.size();
+}
+
+std::size_t SpatialIndex::entity_count() const
+{
+    return entities_.size();
+}
+
+GridIndex::GridIndex( const Point& sw, const Point& ne, double cell_degrees, const Entity::PtrList& entities, geo::kernel::Isa isa ) :
+    SpatialIndex{ isa },
+    sw_{ sw },
+    ne_{ ne },
+    cell_degrees_{ cell_degrees },
+    inverse_cell_{ 0.0 },
+    rows_{ 0 },
+    cols_{ 0 }
+{
+    if ( !( cell_degrees > 0.0 ) ) {
+        throw std::invalid_argument{ "grid cell size must be positive: " + std::to_string( cell_degrees ) };
+    }
+
+    if ( !( ne.lat > sw.lat && ne.lon > sw.lon ) ) {
+        throw std::invalid_argument{ "grid region is empty" };
+    }
+
+    inverse_cell_ = 1.0 / cell_degrees_;
+    rows_ = static_cast<uint32_t>( std::ceil( ( ne.lat - sw.lat ) * inverse_cell_ ) );
+    cols_ = static_cast<uint32_t>( std::ceil( ( ne.lon - sw.lon ) * inverse_cell_ ) );
+
+    // collect the entities of each touched cell, then store the cells in id order so the layout is deterministic.
+    std::unordered_map<uint64_t, Entity::PtrList> contents;
+    std::vector<uint64_t> ids;
+
+    for ( auto& entity_ptr : entities ) {
+        // a corridor is placed by its area, which is wider than its edge; then every point it contains is in a cell
+        // that holds it.
+        const Entity& placed = entity_ptr->get_kind() == geo::EntityKind::CORRIDOR ? static_cast<const geo::Corridor&>( *entity_ptr ).get_area() : *entity_ptr;
+
+        ids.clear();
+        touched_cells( placed, 0, 0, rows_, cols_, ids );
+
+        for ( uint64_t id : ids ) {
+            contents[id].push_back( entity_ptr );
+        }
+    }
+
+    ids.clear();
+    for ( auto& entry : contents ) {
+        ids.push_back( entry.first );
+    }
+    std::sort( ids.begin(), ids.end() );
+
+    cell_ids_.reserve( ids.size() );
+    for ( uint64_t id : ids ) {
+        cell_ids_.emplace( id, static_cast<uint32_t>( add_cell( contents[id] ) ) );
+    }
+}
+
+void GridIndex::touched_cells( const Entity& entity, uint32_t row0, uint32_t col0, uint32_t rows, uint32_t cols, std::vector<uint64_t>& ids ) const
+{
+    // the block extended by the margin of a single cell; it covers the extended cells inside it.
+    double margin = std::max( cell_degrees_ / REDUCTION_FACTOR, MIN_MARGIN_DEGREES );
+    geo::Point sw{ sw_.lat + row0 * cell_degrees_ - margin, sw_.lon + col0 * cell_degrees_ - margin };
+    geo::Point ne{ sw_.lat + ( row0 + rows ) * cell_degrees_ + margin, sw_.lon + ( col0 + cols ) * cell_degrees_ + margin };
+
+    if ( !entity.touches( geo::Bounds{ sw, ne } ) ) {
+        return;
+    }
+
+    if ( rows == 1 && cols == 1 ) {
+        ids.push_back( static_cast<uint64_t>( row0 ) * cols_ + col0 );
+        return;
+    }
+
+    // split the longer side; a linear road is followed without visiting the cells far from it.
+    if ( rows >= cols ) {
+        uint32_t half = rows / 2;
+        touched_cells( entity, row0, col0, half, cols, ids );
+        touched_cells( entity, row0 + half, col0, rows - half, cols, ids );
+    } else {
+        uint32_t half = cols / 2;
+        touched_cells( entity, row0, col0, rows, half, ids );
+        touched_cells( entity, row0, col0 + half, rows, cols - half, ids );
+    }
+}
+
+std::size_t GridIndex::locate( const Point& pt ) const
+{
+    // the same closed bounds as a Quad: points on the north and east borders are in the last row and column.
+    if ( !( sw_.lat <= pt.lat && pt.lat <= ne_.lat && sw_.lon <= pt.lon && pt.lon <= ne_.lon ) ) {
+        return npos;
+    }
+
+    uint32_t row = std::min( static_cast<uint32_t>( ( pt.lat - sw_.lat ) * inverse_cell_ ), rows_ - 1 );
+    uint32_t col = std::min( static_cast<uint32_t>( ( pt.lon - sw_.lon ) * inverse_cell_ ), cols_ - 1 );
+
+    auto search = cell_ids_.find( static_cast<uint64_t>( row ) * cols_ + col );
+    if ( search == cell_ids_.end() ) {
+        return npos;
+    }
+    return search->second;
+}
+
+const char* GridIndex::name() const
+{
+    return "grid";
+}
+
+std::size_t GridIndex::footprint() const
+{
+    // the hash nodes and buckets, approximately.
+    return SpatialIndex::footprint() + cell_ids_.size() * ( sizeof( uint64_t ) + sizeof( uint32_t ) + 2 * sizeof( void* ) ) + cell_ids_.bucket_count() * sizeof( void* );
+}
+
+double GridIndex::cell_degrees() const
+{
+    return cell_degrees_;
+}
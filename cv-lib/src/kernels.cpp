@@ -0,0 +1,237 @@
+/** 
+ * @file 
+ * @copyright Copyright 2017 US DOT - Joint Program Office
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ * http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Contributors:
+ *    Oak Ridge National Laboratory, Center for Trustworthy Embedded Systems, UT Battelle.
+ */
+
+#include <algorithm>
+
+#include "kernels.hpp"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define CVDP_KERNEL_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace geo {
+namespace kernel {
+
+namespace {
+
+/**
+ * @brief The coefficient arrays of one block, offset to its first area.
+ */
+struct Block {
+    const double* dlat[4];
+    const double* dlon[4];
+    const double* c[4];
+};
+
+bool scalar_contains( const Block& block, std::size_t i, double lat, double lon )
+{
+    for ( int k = 0; k < 4; ++k ) {
+        // the same expression as Area::outside_edge, so the answers are identical.
+        double D = -lat * block.dlon[k][i] + lon * block.dlat[k][i] + block.c[k][i];
+        if ( D < 0.0 ) return false;
+    }
+    return true;
+}
+
+bool scalar_any_contains( const Block& block, std::size_t count, double lat, double lon )
+{
+    for ( std::size_t i = 0; i < count; ++i ) {
+        if ( scalar_contains( block, i, lat, lon ) ) return true;
+    }
+    return false;
+}
+
+void scalar_any_contains( const Block& block, std::size_t count, const double* lat, const double* lon, std::size_t n, bool* out )
+{
+    for ( std::size_t p = 0; p < n; ++p ) {
+        out[p] = scalar_any_contains( block, count, lat[p], lon[p] );
+    }
+}
+
+#ifdef CVDP_KERNEL_AVX
+
+// no FMA: each product is rounded before the sum, as in the scalar expression.
+
+__attribute__((target("avx")))
+bool avx_any_contains( const Block& block, std::size_t count, double lat, double lon )
+{
+    const __m256d neg_lat = _mm256_set1_pd( -lat );
+    const __m256d pt_lon = _mm256_set1_pd( lon );
+    const __m256d zero = _mm256_setzero_pd();
+
+    // four areas per step; the block is padded, and the padding lanes are masked off.
+    for ( std::size_t i = 0; i < count; i += AreaArrays::kLanes ) {
+        __m256d outside = zero;
+
+        for ( int k = 0; k < 4; ++k ) {
+            __m256d D = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( neg_lat, _mm256_loadu_pd( block.dlon[k] + i ) ),
+                                                      _mm256_mul_pd( pt_lon, _mm256_loadu_pd( block.dlat[k] + i ) ) ),
+                                       _mm256_loadu_pd( block.c[k] + i ) );
+            outside = _mm256_or_pd( outside, _mm256_cmp_pd( D, zero, _CMP_LT_OQ ) );
+        }
+
+        int inside = ~_mm256_movemask_pd( outside ) & 0xF;
+        std::size_t remaining = count - i;
+        if ( remaining < AreaArrays::kLanes ) {
+            inside &= ( 1 << remaining ) - 1;
+        }
+
+        if ( inside ) return true;
+    }
+    return false;
+}
+
+__attribute__((target("avx")))
+void avx_any_contains( const Block& block, std::size_t count, const double* lat, const double* lon, std::size_t n, bool* out )
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d sign = _mm256_set1_pd( -0.0 );
+    std::size_t p = 0;
+
+    // four points per step against each area in turn.
+    for ( ; p + 4 <= n; p += 4 ) {
+        const __m256d neg_lat = _mm256_xor_pd( _mm256_loadu_pd( lat + p ), sign );
+        const __m256d pt_lon = _mm256_loadu_pd( lon + p );
+        int contained = 0;
+
+        for ( std::size_t i = 0; i < count && contained != 0xF; ++i ) {
+            __m256d outside = zero;
+
+            for ( int k = 0; k < 4; ++k ) {
+                __m256d D = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( neg_lat, _mm256_broadcast_sd( block.dlon[k] + i ) ),
+                                                          _mm256_mul_pd( pt_lon, _mm256_broadcast_sd( block.dlat[k] + i ) ) ),
+                                           _mm256_broadcast_sd( block.c[k] + i ) );
+                outside = _mm256_or_pd( outside, _mm256_cmp_pd( D, zero, _CMP_LT_OQ ) );
+            }
+
+            contained |= ~_mm256_movemask_pd( outside ) & 0xF;
+        }
+
+        for ( int j = 0; j < 4; ++j ) {
+            out[p + j] = ( contained >> j ) & 1;
+        }
+    }
+
+    for ( ; p < n; ++p ) {
+        out[p] = avx_any_contains( block, count, lat[p], lon[p] );
+    }
+}
+
+#endif
+
+} // namespace
+
+Isa supported_isa()
+{
+#ifdef CVDP_KERNEL_AVX
+    static const Isa isa = __builtin_cpu_supports( "avx" ) ? Isa::AVX : Isa::SCALAR;
+    return isa;
+#else
+    return Isa::SCALAR;
+#endif
+}
+
+const char* isa_name( Isa isa )
+{
+    switch ( isa ) {
+        case Isa::AVX:
+            return "avx";
+        default:
+            return "scalar";
+    }
+}
+
+constexpr std::size_t AreaArrays::kLanes;
+
+void AreaArrays::add( const Area& area )
+{
+    const std::vector<Point>& corners = area.get_corners();
+
+    for ( int k = 0; k < 4; ++k ) {
+        const Point& p1 = corners[k];
+        const Point& p2 = corners[( k + 1 ) % 4];
+
+        dlat_[k].push_back( p2.lat - p1.lat );
+        dlon_[k].push_back( p2.lon - p1.lon );
+        c_[k].push_back( p1.lat * ( p2.lon - p1.lon ) - p1.lon * ( p2.lat - p1.lat ) );
+    }
+}
+
+void AreaArrays::pad( std::size_t first )
+{
+    while ( ( size() - first ) % kLanes != 0 ) {
+        for ( int k = 0; k < 4; ++k ) {
+            dlat_[k].push_back( 0.0 );
+            dlon_[k].push_back( 0.0 );
+            c_[k].push_back( 0.0 );
+        }
+    }
+}
+
+std::size_t AreaArrays::size() const
+{
+    return c_[0].size();
+}
+
+bool AreaArrays::any_contains( std::size_t first, std::size_t count, const Point& pt, Isa isa ) const
+{
+    if ( count == 0 ) return false;
+
+    Block block;
+    for ( int k = 0; k < 4; ++k ) {
+        block.dlat[k] = dlat_[k].data() + first;
+        block.dlon[k] = dlon_[k].data() + first;
+        block.c[k] = c_[k].data() + first;
+    }
+
+#ifdef CVDP_KERNEL_AVX
+    if ( isa == Isa::AVX && supported_isa() == Isa::AVX ) {
+        return avx_any_contains( block, count, pt.lat, pt.lon );
+    }
+#endif
+    return scalar_any_contains( block, count, pt.lat, pt.lon );
+}
+
+void AreaArrays::any_contains( std::size_t first, std::size_t count, const double* lat, const double* lon, std::size_t n, bool* out, Isa isa ) const
+{
+    if ( count == 0 ) {
+        std::fill( out, out + n, false );
+        return;
+    }
+
+    Block block;
+    for ( int k = 0; k < 4; ++k ) {
+        block.dlat[k] = dlat_[k].data() + first;
+        block.dlon[k] = dlon_[k].data() + first;
+        block.c[k] = c_[k].data() + first;
+    }
+
+#ifdef CVDP_KERNEL_AVX
+    if ( isa == Isa::AVX && supported_isa() == Isa::AVX ) {
+        avx_any_contains( block, count, lat, lon, n, out );
+        return;
+    }
+#endif
+    scalar_any_contains( block, count, lat, lon, n, out );
+}
+
+} // namespace kernel
+} // namespace geo
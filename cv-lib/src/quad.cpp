@@ -248,3 +248,72 @@ std::vector<geo::Bounds::Ptr> Quad::retrieve_all_bounds( Quad::Ptr& quadptr, boo
 
     return ret;
 }
+
+FrozenQuad::FrozenQuad( const Quad& root, geo::kernel::Isa isa ) :
+    SpatialIndex{ isa }
+{
+    std::vector<const Quad*> order{ &root };
+
+    // breadth first, so the children of each node are adjacent.
+    for ( std::size_t i = 0; i < order.size(); ++i ) {
+        const Quad* quad = order[i];
+        Node node{ quad->sw.lat, quad->sw.lon, quad->ne.lat, quad->ne.lon, 0, 0 };
+
+        if ( quad->haschildren() ) {
+            node.first = static_cast<uint32_t>( order.size() );
+            node.count = static_cast<uint32_t>( quad->children_.size() );
+
+            for ( auto& child : quad->children_ ) {
+                order.push_back( child.get() );
+            }
+
+        } else {
+            node.first = static_cast<uint32_t>( add_cell( quad->element_list_ ) );
+        }
+
+        nodes_.push_back( node );
+    }
+}
+
+std::size_t FrozenQuad::locate( const geo::Point& pt ) const
+{
+    const Node* node = &nodes_.front();
+
+    if ( !node->contains( pt ) ) {
+        return npos;
+    }
+
+    while ( node->count > 0 ) {
+        const Node* child = &nodes_[ node->first ];
+        const Node* last = child + node->count;
+
+        // stop at the first child; retrieval quads are disjoint.
+        while ( child != last && !child->contains( pt ) ) {
+            ++child;
+        }
+
+        if ( child == last ) {
+            // not expected; the children cover their parent.
+            return npos;
+        }
+
+        node = child;
+    }
+
+    return node->first;
+}
+
+const char* FrozenQuad::name() const
+{
+    return "quad";
+}
+
+std::size_t FrozenQuad::footprint() const
+{
+    return SpatialIndex::footprint() + nodes_.size() * sizeof( Node );
+}
+
+std::size_t FrozenQuad::node_count() const
+{
+    return nodes_.size();
+}
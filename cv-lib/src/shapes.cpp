@@ -121,8 +121,8 @@ void CSVInputFactory::make_edge(const StrVector& line_parts) {
 
         // convert all the parts so we can perform checks when the id was previously used.
         vertex_id = std::stoull( point_parts[POINT_ID] );           // throws.
-        lat = std::stod( point_parts[POINT_LAT] );                  // throws.
-        lon = std::stod( point_parts[POINT_LON] );                  // throws.
+        lat = double_utilities::to_double( point_parts[POINT_LAT] ); // throws.
+        lon = double_utilities::to_double( point_parts[POINT_LON] ); // throws.
 
         auto element_item = vertex_map_.find(vertex_id);
         if (element_item != vertex_map_.end()) {
@@ -181,19 +181,19 @@ void CSVInputFactory::make_circle(const StrVector& line_parts)
 	    throw std::out_of_range{ "wrong number of elements for circle center: " + std::to_string( parts.size() ) };
     } 
 
-    double lat = std::stod(parts[0]);
+    double lat = double_utilities::to_double(parts[0]);
 
     if (lat > 80.0 || lat < -84.0) {
         throw std::out_of_range{ "bad latitude: " + std::to_string(lat) };
     }
 
-    double lon = std::stod(parts[1]);
+    double lon = double_utilities::to_double(parts[1]);
 
     if (lon >= 180.0 || lon <= -180.0) {
         throw std::out_of_range{"bad longitude: " + std::to_string(lon) };
     }
 
-    double radius = std::stod(parts[2]);
+    double radius = double_utilities::to_double(parts[2]);
 
     if (radius < 0.0) {
         throw std::out_of_range{"bad radius: " + std::to_string(radius) };
@@ -234,10 +234,10 @@ void CSVInputFactory::make_grid(const StrVector& line_parts) {
 
     // geo_parts has 2 points each defined as a pair (lat, lon)
 
-    double sw_lat = std::stod(geo_parts[0]);
-    double sw_lon = std::stod(geo_parts[1]);
-    double ne_lat = std::stod(geo_parts[2]);
-    double ne_lon = std::stod(geo_parts[3]);
+    double sw_lat = double_utilities::to_double(geo_parts[0]);
+    double sw_lon = double_utilities::to_double(geo_parts[1]);
+    double ne_lat = double_utilities::to_double(geo_parts[2]);
+    double ne_lon = double_utilities::to_double(geo_parts[3]);
 
     if (sw_lat > 80.0 || sw_lat < -84.0) {
         throw std::out_of_range{ "bad latitude: " + std::to_string(sw_lat) };
@@ -26,6 +26,11 @@
 #include "utilities.hpp"
 
 #include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <locale.h>
+#include <stdexcept>
+#include <cstdint>
 
 const std::string string_utilities::DELIMITERS = " \f\n\r\t\v";
 
@@ -67,3 +72,96 @@ StrPair string_utilities::split_attribute( const std::string& s, char delim) {
 bool double_utilities::are_equal(double a, double b, double epsilon) {
     return std::fabs(a - b) < epsilon;
 }
+
+namespace {
+
+// The powers of ten that are exact doubles.
+const double kExactPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const std::size_t kMaxExactDigits = 15;        // every integer with this many digits is an exact double.
+
+/**
+ * @brief Convert a plain decimal, [-]digits[.digits], with at most kMaxExactDigits significant digits.
+ *
+ * @return true if the number was converted; false if it is not such a decimal.
+ */
+bool to_double_exact(const char* str, std::size_t length, double& value) {
+    const char* p = str;
+    const char* end = str + length;
+
+    bool negative = ( p < end && *p == '-' );
+    if ( negative ) ++p;
+
+    uint64_t mantissa = 0;
+    std::size_t digits = 0;                     // the significant digits, after any leading zeros.
+    std::size_t fraction = 0;                   // the digits after the decimal point.
+    bool point = false;
+    bool any = false;
+
+    for ( ; p < end; ++p ) {
+        if ( *p >= '0' && *p <= '9' ) {
+            any = true;
+            if ( point ) ++fraction;
+            if ( mantissa == 0 && *p == '0' ) continue;
+            if ( ++digits > kMaxExactDigits ) return false;
+            mantissa = mantissa * 10 + static_cast<uint64_t>( *p - '0' );
+
+        } else if ( *p == '.' && !point ) {
+            point = true;
+
+        } else {
+            // an exponent, or not a number.
+            return false;
+        }
+    }
+
+    if ( !any || fraction >= sizeof( kExactPowersOf10 ) / sizeof( kExactPowersOf10[0] ) ) return false;
+
+    double d = static_cast<double>( mantissa ) / kExactPowersOf10[ fraction ];
+    value = negative ? -d : d;
+    return true;
+}
+
+/**
+ * @brief strtod in the "C" locale, whatever the locale of the process: the decimal point is always '.'.
+ */
+double strtod_c(const char* str, char** end) {
+    static const locale_t c_locale = newlocale( LC_ALL_MASK, "C", static_cast<locale_t>( 0 ) );
+    return strtod_l( str, end, c_locale );
+}
+
+}  // end namespace.
+
+bool double_utilities::to_double(const char* str, std::size_t length, double& value) {
+    if ( to_double_exact( str, length, value ) ) return true;
+
+    // strtod needs a terminated string.
+    std::string number{ str, length };
+    char* end = nullptr;
+
+    errno = 0;
+    double d = strtod_c( number.c_str(), &end );
+
+    if ( number.empty() || end != number.c_str() + number.size() || errno == ERANGE ) return false;
+
+    value = d;
+    return true;
+}
+
+double double_utilities::to_double(const std::string& s) {
+    double value;
+    if ( to_double( s.data(), s.size(), value ) ) return value;
+
+    // leading whitespace and trailing characters are accepted, and the exceptions are thrown, as std::stod does.
+    char* end = nullptr;
+
+    errno = 0;
+    double d = strtod_c( s.c_str(), &end );
+
+    if ( end == s.c_str() ) throw std::invalid_argument{ "to_double: " + s };
+    if ( errno == ERANGE ) throw std::out_of_range{ "to_double: " + s };
+    return d;
+}
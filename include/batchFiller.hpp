@@ -0,0 +1,86 @@
+#ifndef CVDP_BATCH_FILLER_H
+#define CVDP_BATCH_FILLER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+#include "librdkafka/rdkafkacpp.h"
+
+/**
+ * @brief A BatchFiller collects the consumed messages that are dispatched to the workers together.
+ *
+ * A batch is closed when it has batch_size messages, when batch_linger ms have passed since its first message, or as
+ * soon as the consumer returns anything but a message, e.g., a partition EOF or an error. The first message is waited
+ * for up to the consumer timeout; with no linger only the messages the consumer has already fetched join it.
+ *
+ * The consumer is any callable that takes a timeout in ms and returns a pointer-like message with an err() method, so
+ * the batching does not need a broker.
+ */
+class BatchFiller {
+    public:
+        /**
+         * @brief Construct a filler.
+         *
+         * @param batch_size the maximum number of messages in a batch; at least 1.
+         * @param batch_linger the maximum time (ms) spent filling a batch after its first message.
+         * @param consumer_timeout the maximum time (ms) one consume call waits for a message.
+         */
+        BatchFiller( std::size_t batch_size, int batch_linger, int consumer_timeout ) :
+            batch_size_{ std::max<std::size_t>( 1, batch_size ) },
+            batch_linger_{ std::max( 0, batch_linger ) },
+            consumer_timeout_{ consumer_timeout }
+        {}
+
+        /**
+         * @brief Fill one batch.
+         *
+         * @param consume called with a timeout in ms; returns the next message or event.
+         * @param accept called with each message that joins the batch; takes ownership of it.
+         * @param status called with the event that closed the batch, except the timeout that closes a partial batch.
+         * @param running the batch is closed when this becomes false, e.g., when status sees the end of the input.
+         * @return the number of messages in the batch.
+         */
+        template<typename Consume, typename Accept, typename Status>
+        std::size_t fill( Consume&& consume, Accept&& accept, Status&& status, const bool& running ) const {
+            std::size_t batch_count = 0;
+            std::chrono::steady_clock::time_point deadline;
+
+            while ( running && batch_count < batch_size_ ) {
+                int timeout = consumer_timeout_;
+
+                if ( batch_count > 0 ) {
+                    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() ).count();
+                    if ( remaining < 0 ) break;
+                    timeout = std::min( consumer_timeout_, static_cast<int>( remaining ) );
+                }
+
+                auto msg = consume( timeout );
+
+                if ( msg->err() != RdKafka::ERR_NO_ERROR ) {
+                    // a timeout only closes a partial batch; any other event is reported.
+                    if ( batch_count == 0 || msg->err() != RdKafka::ERR__TIMED_OUT ) {
+                        status( msg.get() );
+                    }
+                    break;
+                }
+
+                if ( batch_count == 0 ) {
+                    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( batch_linger_ );
+                }
+
+                accept( std::move( msg ) );
+                ++batch_count;
+            }
+
+            return batch_count;
+        }
+
+    private:
+        std::size_t batch_size_;                    ///< The maximum number of messages in a batch.
+        int batch_linger_;                          ///< The maximum time (ms) spent filling a batch.
+        int consumer_timeout_;                      ///< The maximum time (ms) one consume call waits.
+};
+
+#endif
@@ -31,6 +31,9 @@
 #include <vector>
 #include <random>
 #include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/memorystream.h"
 #include "cvlib.hpp"
 #include "general-redaction/redactionPropertiesManager.hpp"
 #include "general-redaction/rapidjsonRedactor.hpp"
@@ -38,6 +41,7 @@
 #include "velocityFilter.hpp"
 #include "idRedactor.hpp"
 #include "ppmLogger.hpp"
+#include "jsonArena.hpp"
 
 /**
  * @mainpage
@@ -92,6 +96,89 @@ struct EnumHash {
 };
 
 
+/**
+ * @brief The members of a BSM document that the BSMHandler checks or redacts, found in a single walk over each object
+ * on the fixed path instead of a lookup (or two) per member. A member that is missing, or whose parent is not an
+ * object, is nullptr.
+ */
+struct BSMMembers {
+    rapidjson::Value* metadata;                 ///< metadata
+    rapidjson::Value* sanitized;                ///< metadata.sanitized
+    rapidjson::Value* asn1;                     ///< metadata.asn1
+    rapidjson::Value* payload_type;             ///< metadata.payloadType
+    rapidjson::Value* payload;                  ///< payload
+    rapidjson::Value* data;                     ///< payload.data
+    rapidjson::Value* core_data;                ///< payload.data.coreData
+    rapidjson::Value* speed;                    ///< coreData.speed
+    rapidjson::Value* position;                 ///< coreData.position
+    rapidjson::Value* latitude;                 ///< coreData.position.latitude
+    rapidjson::Value* longitude;                ///< coreData.position.longitude
+    rapidjson::Value* id;                       ///< coreData.id
+    rapidjson::Value* size;                     ///< coreData.size
+    rapidjson::Value* length;                   ///< coreData.size.length
+    rapidjson::Value* width;                    ///< coreData.size.width
+
+    /**
+     * @brief Find all the members of a BSM document.
+     *
+     * @param document the root of the BSM.
+     */
+    void resolve( rapidjson::Value& document );
+};
+
+/**
+ * @brief How a BSMHandler processes a message, by its metadata.payloadType.
+ */
+enum class PayloadKind : uint8_t {
+    UNSUPPORTED,                                ///< Not registered; the message is rejected as MISSING.
+    BSM,                                        ///< Filtered and redacted as a BSM.
+    PASS_THROUGH                                ///< Only the metadata is sanitized and general redaction applied, e.g., TIM or SPaT.
+};
+
+/**
+ * @brief The payload types a handler accepts and how each one is processed. The type strings are copied once when
+ * they are registered; a lookup compares the length and then the characters of the parsed type in place.
+ */
+class PayloadRegistry {
+    public:
+        static const std::string kBsmPayloadType;                       ///< The ODE BSM payload type; always registered.
+
+        /**
+         * @brief Construct a registry with only the BSM payload type.
+         */
+        PayloadRegistry();
+
+        /**
+         * @brief Register a payload type, or change how a registered one is processed.
+         *
+         * @param type the metadata.payloadType string.
+         * @param kind how messages of the type are processed.
+         */
+        void add( const std::string& type, PayloadKind kind );
+
+        /**
+         * @brief Return how messages of a payload type are processed.
+         *
+         * @param type the start of the payload type string; it need not be null terminated.
+         * @param length the number of characters in the payload type.
+         * @return the kind of the type; UNSUPPORTED if it is not registered.
+         */
+        PayloadKind find( const char* type, std::size_t length ) const;
+
+        /**
+         * @brief Return the number of registered payload types.
+         */
+        std::size_t size() const;
+
+    private:
+        struct Entry {
+            std::string type;                                           ///< The payload type string.
+            PayloadKind kind;                                           ///< How its messages are processed.
+        };
+
+        std::vector<Entry> entries_;                                    ///< The registered types; there are only a few.
+};
+
 /** 
  * @brief A BSMHandler processes individual BSMs specified in JSON. While performing this parsing it updates (creates) a
  * BSM instance. A BSMHandler maintains state during the parsing and discontinues parsing if the BSM is determined to
@@ -106,6 +193,27 @@ struct EnumHash {
  *
  * - The id field is redacted for certain prescribed ids.
  *
+ * By default a BSM is parsed into a DOM, modified, and written out again. In the streaming mode
+ * (kStreamParseFlag) the SAX events of the parser are written to the output as they arrive, the redacted fields are
+ * rewritten on the way, and parsing stops as soon as the BSM is suppressed; no DOM is built. General redaction needs
+ * the DOM, so it always uses the DOM mode.
+ *
+ * The DOM mode is compiled once for every combination of the velocity, geofence, id, size, and general redaction
+ * flags; each activation change selects the matching pipeline, so the disabled stages are not in it at all.
+ *
+ * The patch mode (kPatchOutputFlag) parses like the streaming mode but does not write the events: it records where
+ * the replaced values are in the input and then copies the input around them, splicing in the replacements. The
+ * output keeps the formatting of the input. Only the speed and position numbers are converted, by
+ * double_utilities::to_double; the others are passed over as text. The DOM and streaming modes rewrite every number
+ * and leave the conversion to RapidJSON.
+ *
+ * Besides BSMs, the payload types listed in privacy.payload.types are passed through: their metadata is sanitized and
+ * general redaction is applied, but they are not filtered. The streaming modes only check BSMs, so a pass-through
+ * message is handed to the DOM pipeline as soon as its payload type is read.
+ *
+ * With kFastDiscardFlag the DOM mode stops its output work (redaction, the geofence lookup after a speed suppression,
+ * and serialization) as soon as a BSM is suppressed; only the values logged for a suppressed BSM are still recorded.
+ *
  */
 class BSMHandler {
     public:
@@ -124,8 +232,65 @@ class BSMHandler {
         static constexpr uint32_t kIdRedactFlag       = 0x1 << 2;
         static constexpr uint32_t kSizeRedactFlag     = 0x1 << 4;
         static constexpr uint32_t kGeneralRedactFlag  = 0x1 << 8;
+        static constexpr uint32_t kStreamParseFlag    = 0x1 << 9;
+        static constexpr uint32_t kFastDiscardFlag    = 0x1 << 10;
+        static constexpr uint32_t kPatchOutputFlag    = 0x1 << 11;
+
+        static constexpr double kDefaultBoxExtension = 10.0;            ///< The default privacy.filter.geofence.extension.
+
+        /**
+         * @brief A replaced value in the patch mode: the input span [start,end) is replaced by a span of the
+         * replacement text.
+         */
+        struct Splice {
+            std::size_t start;                                          ///< The first replaced character of the input.
+            std::size_t end;                                            ///< One past the last replaced character.
+            std::size_t text_start;                                     ///< The start of the replacement text.
+            std::size_t text_length;                                    ///< The length of the replacement text.
+        };
+
+        /**
+         * @brief A view of the processed BSM JSON held by the handler; it is valid until the next BSM is processed.
+         */
+        struct JsonView {
+            const char* data;                                           ///< The start of the JSON; not null terminated.
+            std::size_t length;                                         ///< The number of characters in the JSON.
+        };
+
+        /**
+         * @brief A BSM handed to #process_batch: a JSON character buffer that need not be null terminated.
+         */
+        struct MessageView {
+            const char* data;                                           ///< The start of the JSON of the BSM.
+            std::size_t length;                                         ///< The number of characters in the JSON.
+        };
 
-        // must be static const to compose these flags and use in template specialization.
+        /**
+         * @brief The results of #process_batch: one result for each message and the retained BSMs written one after
+         * another into a single output buffer. The sink keeps its capacity when it is cleared.
+         */
+        struct ResultSink {
+            /**
+             * @brief The result of one message; a retained message's output is output[offset,offset+length).
+             */
+            struct Result {
+                ResultStatus status;                                    ///< The result of processing the message.
+                bool retained;                                          ///< Whether the BSM is retained.
+                std::size_t offset;                                     ///< The start of the output of the BSM.
+                std::size_t length;                                     ///< The length of the output of the BSM.
+            };
+
+            std::vector<Result> results;                                ///< The results in message order.
+            std::string output;                                         ///< The output of the retained BSMs.
+
+            void clear() {
+                results.clear();
+                output.clear();
+            }
+        };
+
+        // must be static const to compose these flags and use in template specialization; the patch mode parses with
+        // them and converts only the numbers it checks.
         static const unsigned flags = rapidjson::kParseDefaultFlags | rapidjson::kParseNumbersAsStringsFlag;
 
 
@@ -133,15 +298,22 @@ class BSMHandler {
          * @brief Construct a BSMHandler instance using a quad tree of the map data defining the geofence and user-specified
          * configuration.
          *
-         * @param quad_ptr the quad tree containing the map elements.
+         * @param quad_ptr the quad tree containing the map elements; frozen for this handler.
          * @param conf the user-specified configuration.
          */
         BSMHandler(Quad::Ptr quad_ptr, const ConfigMap& conf, std::shared_ptr<PpmLogger> logger);
 
         /**
-         * @brief Predicate indicating whether the BSM's position is within the prescribed geofence.
+         * @brief Construct a BSMHandler instance using a spatial index of the map data, which may be shared with other
+         * handlers, and user-specified configuration.
          *
-         * @todo: entities use string type values; numeric types would be faster.
+         * @param index_ptr the spatial index containing the map elements, e.g., a FrozenQuad or a GridIndex.
+         * @param conf the user-specified configuration.
+         */
+        BSMHandler(SpatialIndex::CPtr index_ptr, const ConfigMap& conf, std::shared_ptr<PpmLogger> logger);
+
+        /**
+         * @brief Predicate indicating whether the BSM's position is within the prescribed geofence.
          *
          * @param bsm the BSM to be checked.
          * @return true if the BSM is within the geofence; false otherwise.
@@ -158,12 +330,34 @@ class BSMHandler {
          *
          */
         bool process( const std::string& bsm_json );
+
+        /** 
+         * @brief Process a BSM presented as a JSON character buffer that need not be null terminated, e.g., a Kafka
+         * message payload. The buffer is parsed in place and is not copied.
+         *
+         * @param bsm_json the start of the JSON of the BSM.
+         * @param length the number of characters in the JSON.
+         * @return true if the BSM is retained; false otherwise.
+         */
+        bool process( const char* bsm_json, std::size_t length );
+
+        /**
+         * @brief Process a batch of BSMs. The parse and output buffers stay with the handler across the batch and the
+         * output of each retained BSM is written directly after the previous one in the sink's output buffer, ready to
+         * be produced as a batch. Only the last BSM of the batch is available from #get_bsm.
+         *
+         * @param msgs the BSMs to process.
+         * @param n the number of BSMs.
+         * @param sink cleared and then filled with the result of each BSM and the output of the retained ones.
+         * @return the number of BSMs retained.
+         */
+        std::size_t process_batch( const MessageView* msgs, std::size_t n, ResultSink& sink );
     
         /**
          * @brief Handle general redaction of fields, the paths for which are specified in fieldsToRedact.txt
          *
          */
-        void handleGeneralRedaction(rapidjson::Document& document);
+        void handleGeneralRedaction(JsonArena::Document& document);
 
         /**
          * @brief Return the result of the most recent BSM processing.
@@ -172,6 +366,18 @@ class BSMHandler {
          */
         const BSMHandler::ResultStatus get_result() const;
 
+        /**
+         * @brief Return how the payload of the most recent message was processed.
+         *
+         * @return the kind of the payload type; UNSUPPORTED if it was not registered or not read.
+         */
+        const PayloadKind get_payload_kind() const;
+
+        /**
+         * @brief Return the payload types this handler accepts.
+         */
+        const PayloadRegistry& get_payload_registry() const;
+
         /**
          * @brief Return the result of the most recent BSM processing as a string.
          *
@@ -189,12 +395,20 @@ class BSMHandler {
 
         /**
          * @brief Return the processed BSM as a JSON string including any changes made due to redaction of fields. This string
-         * is suitable for output and does not contain any newlines.
+         * is suitable for output and does not contain any newlines. The string is copied from the output buffer the
+         * first time it is requested for a BSM; use #get_json_view to avoid the copy.
          *
          * @return a constant reference to the processed BSM as a JSON string.
          */
         const std::string& get_json();
 
+        /**
+         * @brief Return the processed BSM JSON where the handler wrote it, without a copy.
+         *
+         * @return a view of the processed BSM JSON; valid until the next BSM is processed.
+         */
+        JsonView get_json_view() const;
+
         /**
          * @brief Return the size in characters (bytes) of the JSON represented of the processed BSM.
          *
@@ -202,6 +416,15 @@ class BSMHandler {
          */
         std::string::size_type get_bsm_buffer_size(); 
 
+        /**
+         * @brief Hand the processed BSM JSON to another string, e.g., a pooled output buffer, that keeps it after the
+         * handler moves on. The JSON is copied from the output buffer once, or exchanged without a copy when the
+         * handler holds it in a string; either way the other string's storage is reused.
+         *
+         * @param buffer the string that receives the processed BSM JSON.
+         */
+        void swap_json( std::string& buffer );
+
         template<uint32_t FLAG>
         bool is_active() {
             return activated_ & FLAG;
@@ -210,12 +433,14 @@ class BSMHandler {
         template<uint32_t FLAG>
         const uint32_t activate() {
             activated_ |= FLAG;
+            select_pipeline();
             return activated_;
         }
 
         template<uint32_t FLAG>
         const uint32_t deactivate() {
             activated_ &= ~FLAG;
+            select_pipeline();
             return activated_;
         }
 
@@ -232,24 +457,108 @@ class BSMHandler {
         
     private:
 
+        template<typename Output>
+        class StreamFilter;                         ///< The SAX handler of the streaming and patch modes.
+
+        using Pipeline = bool (BSMHandler::*)( const char*, std::size_t );      ///< A DOM pipeline.
+
+        static constexpr std::size_t kPipelineCount = 32;               ///< One for each combination of the 5 feature flags.
+
+        /**
+         * @brief Return the index in the pipeline table of an activation flag word; other flags are ignored.
+         */
+        static constexpr std::size_t pipeline_index( uint32_t activated ) {
+            return ( activated & 0x7 ) | ( ( activated & kSizeRedactFlag ) >> 1 ) | ( ( activated & kGeneralRedactFlag ) >> 4 );
+        }
+
+        /**
+         * @brief Return the feature flags of a pipeline table index; the inverse of pipeline_index.
+         */
+        static constexpr uint32_t pipeline_mask( std::size_t index ) {
+            return static_cast<uint32_t>( ( index & 0x7 ) | ( ( index & 0x8 ) << 1 ) | ( ( index & 0x10 ) << 4 ) );
+        }
+
+        static const Pipeline pipelines_[ kPipelineCount ];             ///< The DOM pipelines by pipeline_index.
+
+        /**
+         * @brief Select the DOM pipeline for the current activation flags.
+         */
+        void select_pipeline();
+
+        /**
+         * @brief Process a BSM by building, modifying, and writing a DOM; the stages of the features that are not in
+         * MASK are compiled out.
+         */
+        template<uint32_t MASK>
+        bool process_document( const char* bsm_json, std::size_t length );
+
+        /**
+         * @brief Forget the output of the previous BSM.
+         */
+        void clear_output();
+
+        /**
+         * @brief Predicate indicating whether a single geofence entity contains a position.
+         */
+        bool entity_contains( const geo::Entity& entity, const geo::Point& pt ) const;
+
+        /**
+         * @brief Predicate indicating whether the BSM being processed is suppressed and the rest of the output work
+         * can be skipped.
+         */
+        bool discarded();
+
+        /**
+         * @brief Process a BSM in a single pass over the SAX events without building a DOM.
+         */
+        bool process_stream( const char* bsm_json, std::size_t length );
+
+        /**
+         * @brief Finish a message the streaming modes stopped on: a pass-through payload is processed by the DOM
+         * pipeline and anything else stays rejected.
+         */
+        bool stream_stopped( const char* bsm_json, std::size_t length );
+
+        /**
+         * @brief Parse a BSM with a StreamFilter that passes its events and replacements to the given output.
+         *
+         * @return true if the BSM is retained.
+         */
+        template<typename Output>
+        bool filter_stream( rapidjson::MemoryStream& input, Output& output );
+
         // JMC: The leak seems to be caused by re-using the RapidJSON document instance.
         // JMC: We will use a unique instance for each message.
         // rapidjson::Document document_;              ///< JSON DOM
+        // A reused document never releases its MemoryPoolAllocator chunks; each message's document now lives in the
+        // arena, which is reset before the next one.
+        JsonArena arena_;                           ///< The memory of the per-message documents.
 
         uint32_t activated_;                        ///< A flag word indicating which features of the privacy protection are activiated.
+        Pipeline pipeline_;                         ///< The DOM pipeline for activated_.
 
-        bool finalized_;                            ///< Indicates the JSON string after redaction has been created and retrieved.
+        bool finalized_;                            ///< Indicates json_ holds the output, i.e., view_ is json_.
         ResultStatus result_;                       ///< Indicates the current state of BSM parsing and what causes failure.
+        PayloadRegistry payloads_;                  ///< The accepted payload types.
+        PayloadKind payload_kind_;                  ///< The kind of the current message's payload.
         BSM bsm_;                                   ///< The BSM instance that is being built through parsing.
-        Quad::Ptr quad_ptr_;                        ///< A pointer to the quad tree containing the map elements.
+        SpatialIndex::CPtr index_ptr_;              ///< A pointer to the spatial index containing the map elements.
         bool get_value_;                            ///< Indicates the next value should be saved.
-        std::string json_;                          ///< The JSON string after redaction.
+        std::string json_;                          ///< The JSON string after redaction; see finalized_.
+        JsonView view_;                             ///< The output: in output_buffer_ or json_.
 
         VelocityFilter vf_;                         ///< The velocity filter functor instance.
         IdRedactor idr_;                            ///< The ID Redactor to use during parsing of BSMs.
 
         double box_extension_;                      ///< The number of meters to extend the boxes that surround edges and define the geofence.
 
+        rapidjson::Reader stream_reader_;                               ///< The streaming mode parser; keeps its stack.
+        rapidjson::StringBuffer output_buffer_;                         ///< The written output; keeps its capacity.
+        rapidjson::Writer<rapidjson::StringBuffer> output_writer_;      ///< Writes the DOM and streaming mode output.
+        std::vector<uint8_t> stream_contexts_;                          ///< The objects and arrays the streaming mode is in.
+        std::vector<Splice> splices_;                                   ///< The replaced values of the patch mode.
+        std::string splice_text_;                                       ///< The replacements of the patch mode.
+
         RedactionPropertiesManager rpm;
         RapidjsonRedactor rapidjsonRedactor;
 
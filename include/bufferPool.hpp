@@ -0,0 +1,73 @@
+#ifndef CVDP_BUFFER_POOL_H
+#define CVDP_BUFFER_POOL_H
+
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief A thread-safe pool of reusable output buffers.
+ *
+ * A buffer is acquired to hold a serialized message, handed to librdkafka without copying, and released back to the
+ * pool from the delivery report callback. Released buffers keep their capacity so, under a steady load, no memory is
+ * allocated to produce messages.
+ */
+class BufferPool {
+
+    public:
+        /**
+         * @brief A pooled buffer: a serialized message and the position of the consumed message it came from, so the
+         * delivery report can acknowledge that message.
+         */
+        struct Buffer {
+            std::string json;                                           ///< The serialized message.
+            int32_t partition;                                          ///< The partition of the consumed message.
+            int64_t offset;                                             ///< The offset of the consumed message.
+        };
+
+        static constexpr std::size_t kDefaultMaxIdle = 1024;            ///< The default number of idle buffers kept.
+
+        /**
+         * @brief Construct an empty pool.
+         *
+         * @param max_idle the maximum number of released buffers kept for reuse; any more are freed.
+         */
+        explicit BufferPool( std::size_t max_idle = kDefaultMaxIdle );
+
+        BufferPool( const BufferPool& ) = delete;
+        BufferPool& operator=( const BufferPool& ) = delete;
+
+        /**
+         * @brief Return an empty buffer; an idle buffer is reused if one is available.
+         *
+         * @return a buffer owned by the caller until it is released.
+         */
+        Buffer* acquire();
+
+        /**
+         * @brief Return a buffer to the pool. Its JSON is cleared but its capacity is kept.
+         *
+         * @param buffer a buffer obtained from acquire; nullptr is ignored.
+         */
+        void release( Buffer* buffer );
+
+        /**
+         * @brief Return the number of idle buffers in the pool.
+         */
+        std::size_t idle() const;
+
+        /**
+         * @brief Return the number of buffers that have been acquired but not released.
+         */
+        std::size_t outstanding() const;
+
+    private:
+        const std::size_t max_idle_;                                    ///< The maximum number of idle buffers.
+        std::vector<std::unique_ptr<Buffer>> idle_;                     ///< The buffers available for reuse.
+        std::size_t outstanding_;                                       ///< The buffers currently acquired.
+        mutable std::mutex mutex_;                                      ///< Guards all of the above.
+};
+
+#endif
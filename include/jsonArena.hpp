@@ -0,0 +1,73 @@
+#ifndef CVDP_JSON_ARENA_H
+#define CVDP_JSON_ARENA_H
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include "rapidjson/document.h"
+
+/**
+ * @brief The memory for parsing one JSON message at a time into a RapidJSON DOM.
+ *
+ * The values and the parse stack come from two memory pools, each backed by a buffer the arena owns. After a message
+ * the pools are reset instead of freed, so a new document costs no allocations once the buffers are large enough. A
+ * message that spills out of a buffer grows it (up to the high-water mark) for the messages that follow; the spilled
+ * chunks, and anything above the high-water mark, are freed at the next reset.
+ */
+class JsonArena {
+
+    public:
+        using Allocator = rapidjson::MemoryPoolAllocator<>;             ///< The allocator of both pools.
+        using Document = rapidjson::GenericDocument<rapidjson::UTF8<>, Allocator, Allocator>;   ///< A DOM in the arena.
+
+        static constexpr std::size_t kDefaultSize = 64 * 1024;          ///< The default initial size of the value buffer.
+        static constexpr std::size_t kDefaultHighWater = 1024 * 1024;   ///< The default largest size of the value buffer.
+        static constexpr std::size_t kStackSize = 16 * 1024;            ///< The initial size of the parse stack buffer.
+        static constexpr std::size_t kMinimumSize = 1024;               ///< The smallest value buffer.
+        static constexpr std::size_t kStackCapacity = 1024;             ///< The initial capacity of a document's parse stack.
+
+        /**
+         * @brief Construct an arena.
+         *
+         * @param size the initial size in bytes of the value buffer; at least kMinimumSize.
+         * @param high_water the size in bytes above which the buffers do not grow.
+         */
+        explicit JsonArena( std::size_t size = kDefaultSize, std::size_t high_water = kDefaultHighWater );
+
+        JsonArena( const JsonArena& ) = delete;
+        JsonArena& operator=( const JsonArena& ) = delete;
+
+        /**
+         * @brief Return the allocator for the values of a document.
+         */
+        Allocator& values();
+
+        /**
+         * @brief Return the allocator for the parse stack of a document.
+         */
+        Allocator& stack();
+
+        /**
+         * @brief Release all the memory of the last document; it must have been destroyed first.
+         */
+        void reset();
+
+        /**
+         * @brief Return the size in bytes of the value buffer.
+         */
+        std::size_t size() const;
+
+    private:
+        /**
+         * @brief Reset one pool, growing its buffer first if the last document spilled out of it.
+         */
+        void reset( std::vector<char>& buffer, std::unique_ptr<Allocator>& pool );
+
+        const std::size_t high_water_;                                  ///< The largest size of either buffer.
+        std::vector<char> value_buffer_;                                ///< The first chunk of the value pool.
+        std::vector<char> stack_buffer_;                                ///< The first chunk of the stack pool.
+        std::unique_ptr<Allocator> value_pool_;                         ///< Allocates the values.
+        std::unique_ptr<Allocator> stack_pool_;                         ///< Allocates the parse stack.
+};
+
+#endif
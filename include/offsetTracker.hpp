@@ -0,0 +1,102 @@
+#ifndef CVDP_OFFSET_TRACKER_H
+#define CVDP_OFFSET_TRACKER_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief An OffsetTracker determines which consumed offsets of a topic can be committed.
+ *
+ * Every consumed message is recorded in consumption order. A message is completed once its output has been delivered
+ * or it has been deliberately suppressed. For each partition the commit offset is one past the highest offset for
+ * which it and every earlier consumed offset are complete, so a committed offset never skips a message whose output
+ * could still be lost (at-least-once delivery). A message that is never completed, e.g., a failed delivery, holds the
+ * commit offset of its partition back; one that is marked failed also asks for the consumer to be restarted from the
+ * committed offsets, after which the tracker is cleared.
+ *
+ * All methods are thread-safe.
+ */
+class OffsetTracker {
+
+    public:
+        using Commit = std::pair<int32_t,int64_t>;                      ///< A partition and the offset to commit for it.
+        using CommitList = std::vector<Commit>;                         ///< The commits for several partitions.
+
+        OffsetTracker();
+
+        /**
+         * @brief Record a consumed message; offsets of a partition must be recorded in increasing order.
+         *
+         * @param partition the partition the message was consumed from.
+         * @param offset the offset of the message.
+         */
+        void consumed( int32_t partition, int64_t offset );
+
+        /**
+         * @brief Mark a consumed message complete.
+         *
+         * @param partition the partition the message was consumed from.
+         * @param offset the offset of the message; offsets that were not recorded are ignored.
+         */
+        void completed( int32_t partition, int64_t offset );
+
+        /**
+         * @brief Record a consumed message whose output could not be delivered. Its partition cannot commit past it, so
+         * the consumer must go back to the committed offsets to process it again; see rewind_needed.
+         *
+         * @param partition the partition the message was consumed from.
+         * @param offset the offset of the message; offsets that were not recorded are ignored.
+         */
+        void failed( int32_t partition, int64_t offset );
+
+        /**
+         * @brief Return true if a message failed since the last clear, i.e., the consumer must be restarted from the
+         * committed offsets.
+         */
+        bool rewind_needed() const;
+
+        /**
+         * @brief Return the commit offset of every partition whose commit offset advanced since the last call.
+         *
+         * @return the partitions and the offsets to commit, i.e., the next offsets to consume.
+         */
+        CommitList take_commits();
+
+        /**
+         * @brief Forget a partition, e.g., when it is revoked from this consumer.
+         *
+         * @param partition the partition to forget.
+         */
+        void erase( int32_t partition );
+
+        /**
+         * @brief Forget every partition, e.g., when the consumer is restarted from its committed offsets.
+         */
+        void clear();
+
+        /**
+         * @brief Return the number of consumed messages that cannot be committed yet.
+         */
+        std::size_t pending() const;
+
+    private:
+        /**
+         * @brief The tracking state of one partition.
+         */
+        struct PartitionState {
+            std::deque<std::pair<int64_t,bool>> offsets;                ///< Consumed offsets not yet committable and whether each is complete.
+            int64_t commit;                                             ///< The offset to commit; -1 if none.
+            bool advanced;                                              ///< The commit offset changed since the last take_commits.
+        };
+
+        std::map<int32_t,PartitionState> partitions_;                   ///< The state of each partition.
+        std::size_t pending_;                                           ///< The total number of tracked offsets.
+        bool failed_;                                                   ///< A tracked message failed since the last clear.
+        mutable std::mutex mutex_;                                      ///< Guards all of the above.
+};
+
+#endif
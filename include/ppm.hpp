@@ -49,12 +49,186 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
 #include "librdkafka/rdkafkacpp.h"
 #include "tool.hpp"
 #include "bsmHandler.hpp"
 #include "cvlib.hpp"
 #include "spdlog/spdlog.h"
 #include "ppmLogger.hpp"
+#include "spscRing.hpp"
+#include "bufferPool.hpp"
+#include "workerDispatcher.hpp"
+#include "offsetTracker.hpp"
+#include "batchFiller.hpp"
+
+class PPM;
+
+using MessageBatch = std::vector<std::unique_ptr<RdKafka::Message>>;   ///< Consumed messages that are processed together.
+
+/**
+ * @brief A retained BSM waiting to be published.
+ */
+struct RetainedBSM {
+    BufferPool::Buffer* buffer;                                         ///< The redacted JSON; owned by the output pool.
+    std::string key;                                                    ///< The consumed message key when keys are forwarded.
+};
+
+using OutputBatch = std::vector<RetainedBSM>;                          ///< The retained BSMs of one processed batch.
+
+/**
+ * @brief A PPMWorker is the processing stage of the PPM pipeline. It processes the BSMs dispatched to it on its own
+ * thread using its own BSMHandler and hands the retained BSMs to the producer thread. All the workers share the same
+ * read-only quad tree that defines the geofence.
+ *
+ * The worker is connected to the consumer thread and to the producer thread by lock-free single-producer
+ * single-consumer rings. A full ring makes the upstream stage wait, so backpressure propagates to the consumer.
+ */
+class PPMWorker {
+
+    public:
+        using Ptr = std::unique_ptr<PPMWorker>;
+
+        /**
+         * @brief Construct a worker and start its thread.
+         *
+         * @param ppm the PPM that consumed the messages and publishes the retained BSMs.
+         * @param index_ptr the spatial index containing the map elements; shared with the other workers.
+         * @param conf the user-specified configuration used to build this worker's BSMHandler.
+         * @param logger the logger shared by the PPM.
+         * @param capacity the number of batches each of the worker's rings holds.
+         */
+        PPMWorker( PPM& ppm, SpatialIndex::CPtr index_ptr, const ConfigMap& conf, std::shared_ptr<PpmLogger> logger, std::size_t capacity );
+
+        /**
+         * @brief Stop the worker after it has processed the messages already dispatched to it.
+         */
+        ~PPMWorker();
+
+        /**
+         * @brief Hand a batch of consumed messages to this worker; waits while the worker's input ring is full. The
+         * worker takes ownership of the messages. Consumer thread only.
+         *
+         * @param batch the messages to process.
+         */
+        void dispatch( MessageBatch&& batch );
+
+        /**
+         * @brief Take the next batch of retained BSMs from this worker without waiting. Producer thread only.
+         *
+         * @param batch the location to move the retained BSMs into.
+         * @return true if a batch was taken; false if none is ready.
+         */
+        bool collect( OutputBatch& batch );
+
+        /**
+         * @brief Process the remaining dispatched messages and join the worker thread. The producer thread must keep
+         * collecting until this returns.
+         */
+        void stop();
+
+        /**
+         * @brief Return the number of batches waiting to be processed.
+         */
+        std::size_t input_depth() const;
+
+        /**
+         * @brief Return the number of processed batches waiting to be produced.
+         */
+        std::size_t output_depth() const;
+
+    private:
+        void run();
+
+        PPM& ppm_;                                                      ///< The PPM that owns this worker.
+        BSMHandler handler_;                                            ///< This worker's handler; never shared.
+        SpscRing<MessageBatch> input_;                                  ///< Consumer thread to this worker.
+        SpscRing<OutputBatch> output_;                                  ///< This worker to the producer thread.
+        std::atomic<bool> stopping_;                                    ///< Finish the dispatched batches and exit.
+        std::thread thread_;                                            ///< The thread that processes the batches.
+};
+
+/**
+ * @brief A PPMPublisher is the producing stage of the PPM pipeline. Its thread collects the retained BSMs from every
+ * worker, produces them, and serves the producer's delivery reports, so broker round trips never stall processing.
+ */
+class PPMPublisher {
+
+    public:
+        /**
+         * @brief Construct the publisher and start its thread.
+         *
+         * @param ppm the PPM whose producer is used.
+         * @param workers the workers to collect from; must outlive the publisher thread.
+         */
+        PPMPublisher( PPM& ppm, const std::vector<PPMWorker::Ptr>& workers );
+
+        /**
+         * @brief Stop the publisher once all collected BSMs are produced.
+         */
+        ~PPMPublisher();
+
+        /**
+         * @brief Produce everything the (already stopped) workers left in their rings and join the publisher thread.
+         */
+        void stop();
+
+    private:
+        void run();
+
+        PPM& ppm_;                                                      ///< The PPM that owns the producer.
+        const std::vector<PPMWorker::Ptr>& workers_;                    ///< The workers to collect from.
+        std::atomic<bool> stopping_;                                    ///< Drain the workers' rings and exit.
+        std::thread thread_;                                            ///< The thread that produces.
+};
+
+/**
+ * @brief The delivery report callback for the PPM producer. It is called when librdkafka is finished with a produced
+ * BSM, successfully or not.
+ */
+class PPMDeliveryReport : public RdKafka::DeliveryReportCb {
+
+    public:
+        /**
+         * @brief Construct the callback for the given PPM.
+         */
+        explicit PPMDeliveryReport( PPM& ppm );
+
+        void dr_cb( RdKafka::Message& message ) override;
+
+    private:
+        PPM& ppm_;                                                      ///< The PPM that produced the messages.
+};
+
+/**
+ * @brief The rebalance callback for the PPM consumer. It is called, on the consumer thread, when partitions are assigned
+ * to or revoked from this PPM by the consumer group.
+ */
+class PPMRebalance : public RdKafka::RebalanceCb {
+
+    public:
+        /**
+         * @brief Construct the callback for the given PPM.
+         */
+        explicit PPMRebalance( PPM& ppm );
+
+        void rebalance_cb( RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& partitions ) override;
+
+    private:
+        PPM& ppm_;                                                      ///< The PPM whose consumer is rebalanced.
+};
+
+/**
+ * @brief The state the PPM keeps for each partition assigned to its consumer; created on assignment and destroyed on
+ * revocation.
+ */
+struct PartitionState {
+    bool eof;                                                           ///< The end of the partition has been reached.
+    long consumed;                                                      ///< The number of BSMs consumed since the assignment.
+};
 
 class PPM : public tool::Tool {
 
@@ -73,7 +247,134 @@ class PPM : public tool::Tool {
         bool launch_consumer();
         bool launch_producer();
         bool msg_consume(RdKafka::Message* message, void* opaque, BSMHandler& handler);
-        Quad::Ptr BuildGeofence( const std::string& mapfile );
+
+        /**
+         * @brief Handle a consumer event that does not carry a BSM, e.g., timeouts, partition EOF, and errors.
+         *
+         * @param message the message returned by the consumer.
+         */
+        void consume_status(RdKafka::Message* message);
+
+        /**
+         * @brief Process a batch of consumed BSMs with the given handler. The JSON of each retained BSM is moved into a
+         * pooled output buffer. This is called by the worker threads, so it only touches thread-safe PPM state.
+         *
+         * @param batch the consumed messages.
+         * @param handler the calling worker's handler.
+         * @param retained the batch the retained BSMs are appended to.
+         */
+        void process_batch(MessageBatch& batch, BSMHandler& handler, OutputBatch& retained);
+
+        /**
+         * @brief Produce a batch of retained BSMs and then serve the producer's delivery reports once for the whole
+         * batch. This is called by the producer thread.
+         *
+         * @param retained the retained BSMs; their buffers belong to librdkafka until they are delivered.
+         */
+        void publish(OutputBatch& retained);
+
+        /**
+         * @brief Serve the producer's pending delivery reports without waiting. In transactional mode a transaction
+         * that is due is also committed.
+         */
+        void poll_producer();
+
+        /**
+         * @brief In transactional mode, commit the open transaction and the offsets it covers. Called by the producer
+         * thread when it stops.
+         */
+        void complete_transaction();
+
+        /**
+         * @brief Commit, for every partition, the offset after the last consumed message that has been delivered or
+         * suppressed along with all the messages before it. Only used when Kafka auto commit is disabled.
+         *
+         * @param synchronous wait for the commit to finish, e.g., during shutdown.
+         */
+        void commit_offsets(bool synchronous);
+
+        /**
+         * @brief Open a producer transaction if none is open. Producer thread only.
+         *
+         * @return true if a transaction is open; false if it could not be started.
+         */
+        bool begin_transaction();
+
+        /**
+         * @brief Commit the open transaction together with the offsets of the consumed messages it covers once it holds
+         * txn_size BSMs or txn_interval ms have passed since the last commit. Offsets of suppressed BSMs are committed
+         * in a transaction even if no BSM was produced. Producer thread only.
+         *
+         * @param force commit now.
+         */
+        void commit_transaction(bool force);
+
+        /**
+         * @brief Handle a failed transaction operation, including a BSM that could not be produced into the open
+         * transaction. The transaction is aborted and the consumer is restarted from the committed offsets; a fatal
+         * error stops the PPM.
+         *
+         * @param error the error; deleted by this method.
+         * @param action the operation that failed.
+         */
+        void transaction_failed(RdKafka::Error* error, const std::string& action);
+
+        /**
+         * @brief Log the depth of every pipeline ring and the number of BSMs librdkafka has not yet delivered.
+         */
+        void log_pipeline_stats();
+
+        /**
+         * @brief Handle the delivery report of a produced BSM; only delivered BSMs are counted as published. Its output
+         * buffer is returned to the pool.
+         *
+         * @param message the produced message; its opaque pointer is the output buffer.
+         */
+        void delivered(RdKafka::Message& message);
+
+        /**
+         * @brief Handle a consumer group rebalance. Assigned partitions get new partition state. Before partitions are
+         * revoked, all the work in the pipeline is finished and the offsets are committed, so the next owner of the
+         * partitions does not reprocess them; then their state is destroyed.
+         *
+         * @param kafka_consumer the rebalanced consumer.
+         * @param err ERR__ASSIGN_PARTITIONS, ERR__REVOKE_PARTITIONS, or an error.
+         * @param changed the partitions that are assigned or revoked.
+         */
+        void rebalance(RdKafka::KafkaConsumer* kafka_consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& changed);
+
+        /**
+         * @brief Hand the consumed batches to the workers. Consumer thread only.
+         */
+        void dispatch_batches();
+
+        /**
+         * @brief Wait until every consumed BSM has been suppressed or delivered and commit the offsets (or the
+         * transaction). Consumer thread only.
+         */
+        void drain_pipeline();
+
+        /**
+         * @brief Set a global Kafka configuration parameter on conf and record it for the producer and consumer
+         * configurations.
+         *
+         * @return the result of setting the parameter on conf.
+         */
+        RdKafka::Conf::ConfResult set_kafka(const std::string& name, const std::string& value, std::string& error_string);
+
+        /**
+         * @brief Create a global Kafka configuration with every recorded parameter except one that does not apply to
+         * the role, so the producer and the consumer each get their own.
+         *
+         * @param skipped the parameter left out, e.g., transactional.id for the consumer.
+         * @return the new configuration; owned by the caller.
+         */
+        RdKafka::Conf* create_role_conf(const std::string& skipped) const;
+
+        /**
+         * @brief Build the spatial index of the geofence selected by privacy.filter.geofence.index from a map file.
+         */
+        SpatialIndex::CPtr BuildGeofence( const std::string& mapfile );
         int operator()(void);
 
         /**
@@ -97,16 +398,47 @@ class PPM : public tool::Tool {
         static bool bsms_available;                                     ///> flag to find consumer/produce bsms; set via signals so static.
 
         bool exit_eof;                                                  ///> flag to cause the application to exit on stream eof.
-        int eof_cnt;                                                    ///> counts the number of eofs needed for exit_eof to work; each partition must end.
-        int partition_cnt;                                              ///> TODO: the number of partitions being processed; currently 1.
+        int partition_cnt;                                              ///> the number of partitions assigned to the consumer.
+        std::map<int32_t, PartitionState> assigned_partitions;          ///> the partitions assigned to the consumer; consumer thread only.
 
-        // counters.
-        long bsm_recv_count;                                            ///> Counter for the number of BSMs received.
-        long bsm_send_count;                                            ///> Counter for the number of BSMs published.
-        long bsm_filt_count;                                            ///> Counter for hte number of BSMs filtered/suppressed.
-        int64_t bsm_recv_bytes;                                         ///> Counter for the number of BSM bytes received.
-        int64_t bsm_send_bytes;                                         ///> Counter for the nubmer of BSM bytes published.
-        int64_t bsm_filt_bytes;                                         ///> Counter for the nubmer of BSM bytes filtered/suppressed.
+        // counters; updated by the worker and producer threads.
+        std::atomic<long> bsm_recv_count;                               ///> Counter for the number of BSMs received.
+        std::atomic<long> bsm_send_count;                               ///> Counter for the number of BSMs delivered to the broker.
+        std::atomic<long> bsm_filt_count;                               ///> Counter for hte number of BSMs filtered/suppressed.
+        std::atomic<int64_t> bsm_recv_bytes;                            ///> Counter for the number of BSM bytes received.
+        std::atomic<int64_t> bsm_send_bytes;                            ///> Counter for the nubmer of BSM bytes delivered to the broker.
+        std::atomic<long> bsm_fail_count;                               ///> Counter for the number of retained BSMs that could not be delivered.
+        std::atomic<long> bsm_inflight_count;                           ///> The number of produced BSMs without a delivery report.
+        std::atomic<long> bsm_pending_count;                            ///> The number of consumed BSMs not yet suppressed, delivered, or dropped.
+        std::atomic<int64_t> bsm_filt_bytes;                            ///> Counter for the nubmer of BSM bytes filtered/suppressed.
+
+        int worker_count;                                               ///> The number of threads processing BSMs.
+        std::size_t worker_queue_size;                                  ///> The capacity, in batches, of each pipeline ring.
+        std::size_t batch_size;                                         ///> The maximum number of messages consumed in one batch.
+        int batch_linger;                                               ///> The maximum time (ms) spent filling one batch.
+        int stats_interval;                                             ///> The time (ms) between pipeline stats logs; 0 = off.
+        bool forward_keys;                                              ///> Produce retained BSMs with their consumed message key; partitions the output by key.
+        long max_inflight;                                              ///> The maximum number of produced BSMs without a delivery report.
+        bool manual_commit;                                             ///> Offsets are committed by the PPM (enable.auto.commit=false).
+        int commit_interval;                                            ///> The time (ms) between offset commits.
+        OffsetTracker offsets;                                          ///> The consumed offsets that are not yet safe to commit.
+
+        // transactional (exactly-once) mode; the transaction state is only used by the producer thread.
+        bool transactional;                                             ///> Produce and commit offsets in transactions (transactional.id is set).
+        std::size_t txn_size;                                           ///> The number of BSMs that triggers a transaction commit.
+        int txn_interval;                                               ///> The maximum time (ms) between transaction commits.
+        int txn_timeout;                                                ///> The time (ms) allowed for each transaction operation.
+        bool txn_open;                                                  ///> A transaction has been started and not committed.
+        std::size_t txn_count;                                          ///> The number of BSMs produced in the open transaction.
+        std::chrono::steady_clock::time_point txn_last;                 ///> When the last transaction was committed.
+        std::atomic<bool> txn_aborted;                                  ///> A transaction was aborted; the consumer must rewind.
+        std::atomic<bool> txn_commit_requested;                         ///> The consumer thread needs the open transaction committed now.
+        std::atomic<unsigned> txn_commits;                              ///> The number of requested transaction commits completed.
+
+        // the pipeline; exists while BSMs are being consumed.
+        std::vector<PPMWorker::Ptr> workers;                            ///> The processing stage.
+        std::unique_ptr<PPMPublisher> publisher;                        ///> The producing stage.
+        std::vector<MessageBatch> batches;                              ///> The batches being filled for each worker; consumer thread only.
 
         std::string mode;
         std::string debug;
@@ -121,8 +453,16 @@ class PPM : public tool::Tool {
         std::unordered_map<std::string, std::string> pconf;
         RdKafka::Conf *conf;
         RdKafka::Conf *tconf;
+        std::vector<std::pair<std::string, std::string>> kafka_settings; ///> The global parameters set on conf, in order.
+        RdKafka::Conf *producer_conf;                                   ///> The producer's copy of conf, e.g., with transactional.id.
+        RdKafka::Conf *consumer_conf;                                   ///> The consumer's copy of conf, e.g., with enable.auto.commit.
+
+        SpatialIndex::CPtr geofence;
 
-        Quad::Ptr qptr;
+        // must outlive the producer, which holds buffers until they are delivered.
+        BufferPool output_buffers;                                      ///> The pooled buffers used to produce retained BSMs.
+        PPMDeliveryReport delivery_report;                              ///> Returns the buffers to the pool.
+        PPMRebalance rebalance_handler;                                 ///> Tracks the partitions assigned to the consumer.
 
         std::shared_ptr<RdKafka::KafkaConsumer> consumer;
         int consumer_timeout;
@@ -0,0 +1,107 @@
+#ifndef CVDP_SPSC_RING_H
+#define CVDP_SPSC_RING_H
+
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+/**
+ * @brief A bounded, lock-free, single-producer single-consumer ring buffer.
+ *
+ * Exactly one thread may push and exactly one (other) thread may pop. Neither operation blocks; callers that need to
+ * wait, e.g., to propagate backpressure, retry using ring_backoff.
+ */
+template<typename T>
+class SpscRing {
+    public:
+        /**
+         * @brief Construct an empty ring.
+         *
+         * @param capacity the minimum number of items the ring can hold; rounded up to a power of two.
+         */
+        explicit SpscRing( std::size_t capacity ) :
+            slots_( round_capacity( capacity ) ),
+            mask_{ slots_.size() - 1 },
+            head_{ 0 },
+            tail_{ 0 }
+        {}
+
+        SpscRing( const SpscRing& ) = delete;
+        SpscRing& operator=( const SpscRing& ) = delete;
+
+        /**
+         * @brief Add an item to the ring; producer thread only.
+         *
+         * @param item the item to add; it is moved from only when it is added.
+         * @return true if the item was added; false if the ring is full.
+         */
+        bool try_push( T&& item ) {
+            const std::size_t tail = tail_.load( std::memory_order_relaxed );
+            if ( tail - head_.load( std::memory_order_acquire ) == slots_.size() ) return false;
+
+            slots_[ tail & mask_ ] = std::move( item );
+            tail_.store( tail + 1, std::memory_order_release );
+            return true;
+        }
+
+        /**
+         * @brief Remove the oldest item from the ring; consumer thread only.
+         *
+         * @param item the location to move the removed item into.
+         * @return true if an item was removed; false if the ring is empty.
+         */
+        bool try_pop( T& item ) {
+            const std::size_t head = head_.load( std::memory_order_relaxed );
+            if ( head == tail_.load( std::memory_order_acquire ) ) return false;
+
+            item = std::move( slots_[ head & mask_ ] );
+            head_.store( head + 1, std::memory_order_release );
+            return true;
+        }
+
+        /**
+         * @brief Return the number of items in the ring; exact only when called from the producer or consumer thread.
+         */
+        std::size_t size() const {
+            return tail_.load( std::memory_order_acquire ) - head_.load( std::memory_order_acquire );
+        }
+
+        /**
+         * @brief Return the number of items the ring can hold.
+         */
+        std::size_t capacity() const {
+            return slots_.size();
+        }
+
+    private:
+        static std::size_t round_capacity( std::size_t capacity ) {
+            std::size_t rounded = 1;
+            while ( rounded < capacity ) rounded <<= 1;
+            return rounded;
+        }
+
+        std::vector<T> slots_;                                          ///< The storage; size is a power of two.
+        const std::size_t mask_;                                        ///< Maps an index to a slot.
+        char pad0_[64];                                                 ///< Keeps the indices on separate cache lines.
+        std::atomic<std::size_t> head_;                                 ///< The next slot to pop; written by the consumer.
+        char pad1_[64];
+        std::atomic<std::size_t> tail_;                                 ///< The next slot to push; written by the producer.
+        char pad2_[64];
+};
+
+/**
+ * @brief Wait a little before retrying a ring operation: yield for the first attempts and then sleep briefly.
+ *
+ * @param attempts the number of consecutive failed attempts; incremented by this call and reset by the caller on success.
+ */
+inline void ring_backoff( unsigned& attempts ) {
+    if ( attempts++ < 64 ) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+    }
+}
+
+#endif
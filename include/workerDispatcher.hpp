@@ -0,0 +1,68 @@
+#ifndef CVDP_WORKER_DISPATCHER_H
+#define CVDP_WORKER_DISPATCHER_H
+
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+using ConfigMap = std::unordered_map<std::string,std::string>;            ///< An alias to a string key - value configuration for the privacy parameters.
+
+/**
+ * @brief A WorkerDispatcher chooses the worker that processes a consumed message.
+ *
+ * In partition mode (the default) all the messages from a Kafka partition go to the same worker. In key mode the
+ * messages are routed by the vehicle id (coreData.id) found with a light scan of the payload, whether or not they have
+ * a Kafka message key; messages without an id are routed by their key, and messages with neither by partition. Either
+ * way the messages of one vehicle are processed in order. Routing is a pure function of the message, so no lock is
+ * needed.
+ */
+class WorkerDispatcher {
+
+    public:
+        enum DispatchMode : uint8_t { PARTITION, KEY };
+
+        /**
+         * @brief Construct a dispatcher using the privacy.workers.dispatch setting.
+         *
+         * @param conf the user-specified configuration.
+         * @param workers the number of workers; at least 1.
+         */
+        WorkerDispatcher( const ConfigMap& conf, std::size_t workers );
+
+        /**
+         * @brief Return the index of the worker that should process a message.
+         *
+         * @param partition the partition the message was consumed from.
+         * @param key the Kafka message key; may be nullptr.
+         * @param key_len the length of the key.
+         * @param payload the message payload.
+         * @param len the length of the payload.
+         * @return a worker index in [0,workers).
+         */
+        std::size_t route( int32_t partition, const void* key, std::size_t key_len, const char* payload, std::size_t len ) const;
+
+        DispatchMode get_mode() const;
+
+        /**
+         * @brief Return the 64-bit FNV-1a hash of a byte sequence.
+         */
+        static uint64_t fnv1a( const char* data, std::size_t len );
+
+        /**
+         * @brief Find the value of the coreData id member in a BSM JSON payload without parsing the payload. Strings are
+         * skipped whole, and only a member of the coreData object itself is taken, not one of an object nested in it.
+         *
+         * @param payload the JSON payload.
+         * @param len the length of the payload.
+         * @param id set to the first character of the id value when found.
+         * @param id_len set to the length of the id value when found.
+         * @return true if the id was found; false otherwise.
+         */
+        static bool find_vehicle_id( const char* payload, std::size_t len, const char*& id, std::size_t& id_len );
+
+    private:
+        DispatchMode mode_;                         ///< How messages are routed.
+        std::size_t workers_;                       ///< The number of workers.
+};
+
+#endif
@@ -29,6 +29,8 @@
 #include <sstream>
 #include <random>
 #include <limits>
+#include <cstring>
+#include <algorithm>
 
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
@@ -47,16 +49,63 @@ BSMHandler::ResultStringMap BSMHandler::result_string_map{
             { ResultStatus::OTHER, "other" }
         };
 
+/**
+ * @brief Return a size in bytes from the configuration.
+ *
+ * @return the configured size; the default if the key is not configured or its value is not a positive size.
+ */
+static std::size_t size_setting( const ConfigMap& conf, const std::string& key, std::size_t default_size, const std::shared_ptr<PpmLogger>& logger ) {
+    auto search = conf.find( key );
+    if ( search == conf.end() ) return default_size;
+
+    try {
+        std::size_t size = std::stoul( search->second );
+        if ( size > 0 ) return size;
+    } catch( std::exception& e ) {
+    }
+
+    if ( logger ) logger->info("invalid " + key + ": " + search->second + "; using the default value.");
+    return default_size;
+}
+
+/**
+ * @brief Return the size the document arena does not grow beyond; never below its initial size.
+ */
+static std::size_t arena_high_water( const ConfigMap& conf, const std::shared_ptr<PpmLogger>& logger ) {
+    std::size_t size = size_setting( conf, "privacy.parse.arena.size", JsonArena::kDefaultSize, logger );
+    std::size_t high_water = size_setting( conf, "privacy.parse.arena.max", JsonArena::kDefaultHighWater, logger );
+    if ( high_water >= size ) return high_water;
+
+    if ( logger ) logger->info("privacy.parse.arena.max is below privacy.parse.arena.size; using the default value.");
+    return std::max<std::size_t>( JsonArena::kDefaultHighWater, size );
+}
+
 BSMHandler::BSMHandler(Quad::Ptr quad_ptr, const ConfigMap& conf, std::shared_ptr<PpmLogger> logger ):
+    BSMHandler{ quad_ptr ? std::make_shared<const FrozenQuad>(*quad_ptr) : SpatialIndex::CPtr{}, conf, logger }
+{}
+
+BSMHandler::BSMHandler(SpatialIndex::CPtr index_ptr, const ConfigMap& conf, std::shared_ptr<PpmLogger> logger ):
+    arena_{ size_setting( conf, "privacy.parse.arena.size", JsonArena::kDefaultSize, logger ), arena_high_water( conf, logger ) },
     activated_{0},
+    pipeline_{ pipelines_[0] },
+    finalized_{ false },
     result_{ ResultStatus::SUCCESS },
+    payloads_{},
+    payload_kind_{ PayloadKind::UNSUPPORTED },
     bsm_{},
-    quad_ptr_{quad_ptr},
-    finalized_{ false },
+    index_ptr_{index_ptr},
+    get_value_{ false },
     json_{},
+    view_{ "", 0 },
     vf_{ conf },
     idr_{ conf },
-    box_extension_{ 10.0 },
+    box_extension_{ kDefaultBoxExtension },
+    stream_reader_{},
+    output_buffer_{},
+    output_writer_{ output_buffer_ },
+    stream_contexts_{},
+    splices_{},
+    splice_text_{},
     logger_{ logger }
 {
     if (logger_ == nullptr) {
@@ -91,6 +140,27 @@ BSMHandler::BSMHandler(Quad::Ptr quad_ptr, const ConfigMap& conf, std::shared_pt
         activate<BSMHandler::kGeneralRedactFlag>();
     }
 
+    search = conf.find("privacy.filter.fast.discard");
+    if ( search != conf.end() && search->second=="ON" ) {
+        activate<BSMHandler::kFastDiscardFlag>();
+    }
+
+    search = conf.find("privacy.parse.mode");
+    if ( search != conf.end() && search->second=="STREAM" ) {
+        activate<BSMHandler::kStreamParseFlag>();
+    } else if ( search != conf.end() && search->second=="PATCH" ) {
+        activate<BSMHandler::kStreamParseFlag>();
+        activate<BSMHandler::kPatchOutputFlag>();
+    }
+
+    search = conf.find("privacy.payload.types");
+    if ( search != conf.end() ) {
+        for ( auto& type : string_utilities::split( search->second, ',' ) ) {
+            string_utilities::strip( type );
+            if ( !type.empty() ) payloads_.add( type, PayloadKind::PASS_THROUGH );
+        }
+    }
+
     search = conf.find("privacy.filter.geofence.extension");
     if ( search != conf.end() ) {
         box_extension_ = std::stod( search->second );
@@ -98,59 +168,838 @@ BSMHandler::BSMHandler(Quad::Ptr quad_ptr, const ConfigMap& conf, std::shared_pt
 }
 
 bool BSMHandler::isWithinEntity(BSM &bsm) const {
-    geo::Circle::CPtr circle_ptr = nullptr;
-    geo::EdgeCPtr edge_ptr = nullptr;
-    geo::Grid::CPtr grid_ptr = nullptr;
-    geo::AreaPtr area_ptr = nullptr;
+    std::size_t cell = index_ptr_->locate(bsm);
 
-    geo::Entity::PtrList entity_set = quad_ptr_->retrieve_elements(bsm); 
+    if (index_ptr_->corridor_extension() == box_extension_) {
+        // the cell's corridor areas are tested together; only the other entities are tested one at a time.
+        if (index_ptr_->corridors_contain(cell, bsm)) {
+            return true;
+        }
 
-    for (auto& entity_ptr : entity_set) {
+        for (const geo::Entity& entity : index_ptr_->others(cell)) {
+            if (entity_contains(entity, bsm)) {
+                return true;
+            }
+        }
+        return false;
+    }
 
-        edge_ptr = std::static_pointer_cast<const geo::Edge>(entity_ptr); 
+    for (const geo::Entity& entity : index_ptr_->elements(cell)) {
+        if (entity_contains(entity, bsm)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-        if (entity_ptr->get_type() == "edge") {
-            edge_ptr = std::static_pointer_cast<const geo::Edge>(entity_ptr); 
-            area_ptr = edge_ptr->to_area(box_extension_);
+bool BSMHandler::entity_contains(const geo::Entity& entity, const geo::Point& pt) const {
+    // the kind selects the cast; no type strings are built or compared.
+    switch (entity.get_kind()) {
+        case geo::EntityKind::CORRIDOR: {
+            // the area was computed when the map was loaded; only one computed for another extension is rebuilt.
+            const geo::Corridor& corridor = static_cast<const geo::Corridor&>(entity);
 
-            if (area_ptr->contains(bsm)) {
-                return true;
+            if (corridor.get_extension() == box_extension_) {
+                return corridor.contains(pt);
+            }
+            return corridor.get_edge()->to_area(box_extension_)->contains(pt);
+        }
+
+        case geo::EntityKind::EDGE:
+            return static_cast<const geo::Edge&>(entity).to_area(box_extension_)->contains(pt);
+
+        case geo::EntityKind::CIRCLE:
+            return static_cast<const geo::Circle&>(entity).contains(pt);
+
+        case geo::EntityKind::GRID:
+            return static_cast<const geo::Grid&>(entity).contains(pt);
+
+        default:
+            return false;
+    }
+}
+
+namespace {
+
+// The fixed member names of a BSM. A Value made from a string literal is a constant string that knows its length, so
+// comparing a member name with it is a length check and a memcmp; no strlen and no copy.
+const rapidjson::Value kMetadataName{ rapidjson::StringRef( "metadata" ) };
+const rapidjson::Value kSanitizedName{ rapidjson::StringRef( "sanitized" ) };
+const rapidjson::Value kAsn1Name{ rapidjson::StringRef( "asn1" ) };
+const rapidjson::Value kPayloadTypeName{ rapidjson::StringRef( "payloadType" ) };
+const rapidjson::Value kPayloadName{ rapidjson::StringRef( "payload" ) };
+const rapidjson::Value kDataName{ rapidjson::StringRef( "data" ) };
+const rapidjson::Value kCoreDataName{ rapidjson::StringRef( "coreData" ) };
+const rapidjson::Value kSpeedName{ rapidjson::StringRef( "speed" ) };
+const rapidjson::Value kPositionName{ rapidjson::StringRef( "position" ) };
+const rapidjson::Value kLatitudeName{ rapidjson::StringRef( "latitude" ) };
+const rapidjson::Value kLongitudeName{ rapidjson::StringRef( "longitude" ) };
+const rapidjson::Value kIdName{ rapidjson::StringRef( "id" ) };
+const rapidjson::Value kSizeName{ rapidjson::StringRef( "size" ) };
+const rapidjson::Value kLengthName{ rapidjson::StringRef( "length" ) };
+const rapidjson::Value kWidthName{ rapidjson::StringRef( "width" ) };
+const rapidjson::Value kPartIIName{ rapidjson::StringRef( "partII" ) };
+
+/**
+ * @brief Find the members with the given names in one walk over the members of an object; the first member with a
+ * name wins, as with FindMember.
+ *
+ * @param object the value to search; if it is nullptr or not an object, nothing is found.
+ * @param names the member names.
+ * @param found set to the members found, or nullptr.
+ */
+template<std::size_t N>
+void find_members( rapidjson::Value* object, const rapidjson::Value* const (&names)[N], rapidjson::Value** const (&found)[N] ) {
+    for ( auto* value : found ) *value = nullptr;
+
+    if ( !object || !object->IsObject() ) return;
+
+    std::size_t remaining = N;
+    for ( auto member = object->MemberBegin(); member != object->MemberEnd() && remaining > 0; ++member ) {
+        // member names are always strings; compare the lengths before the characters.
+        const rapidjson::SizeType length = member->name.GetStringLength();
+        const char* name = member->name.GetString();
+
+        for ( std::size_t i = 0; i < N; ++i ) {
+            if ( !*found[i] && length == names[i]->GetStringLength() && std::memcmp( name, names[i]->GetString(), length ) == 0 ) {
+                *found[i] = &member->value;
+                --remaining;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Return the member of an object with the given name, or nullptr.
+ */
+rapidjson::Value* find_member( rapidjson::Value* object, const rapidjson::Value& name ) {
+    if ( !object || !object->IsObject() ) return nullptr;
+
+    auto member = object->FindMember( name );
+    return member == object->MemberEnd() ? nullptr : &member->value;
+}
+
+}
+
+void BSMMembers::resolve( rapidjson::Value& document ) {
+    find_members( &document, { &kMetadataName, &kPayloadName }, { &metadata, &payload } );
+    find_members( metadata, { &kSanitizedName, &kAsn1Name, &kPayloadTypeName }, { &sanitized, &asn1, &payload_type } );
+
+    data = find_member( payload, kDataName );
+    core_data = find_member( data, kCoreDataName );
+
+    find_members( core_data, { &kSpeedName, &kPositionName, &kIdName, &kSizeName }, { &speed, &position, &id, &size } );
+    find_members( position, { &kLatitudeName, &kLongitudeName }, { &latitude, &longitude } );
+    find_members( size, { &kLengthName, &kWidthName }, { &length, &width } );
+}
+
+const std::string PayloadRegistry::kBsmPayloadType{ "us.dot.its.jpo.ode.model.OdeBsmPayload" };
+
+PayloadRegistry::PayloadRegistry() :
+    entries_{ { kBsmPayloadType, PayloadKind::BSM } }
+{}
+
+void PayloadRegistry::add( const std::string& type, PayloadKind kind ) {
+    for ( auto& entry : entries_ ) {
+        if ( entry.type == type ) {
+            entry.kind = kind;
+            return;
+        }
+    }
+
+    entries_.push_back( { type, kind } );
+}
+
+PayloadKind PayloadRegistry::find( const char* type, std::size_t length ) const {
+    for ( const auto& entry : entries_ ) {
+        if ( entry.type.size() == length && std::memcmp( entry.type.data(), type, length ) == 0 ) {
+            return entry.kind;
+        }
+    }
+
+    return PayloadKind::UNSUPPORTED;
+}
+
+std::size_t PayloadRegistry::size() const {
+    return entries_.size();
+}
+
+bool BSMHandler::process( const std::string& message_json ) {
+    return process( message_json.data(), message_json.size() );
+}
+
+bool BSMHandler::process( const char* message_json, std::size_t length ) {
+    // general redaction works on paths in the DOM.
+    if ( is_active<kStreamParseFlag>() && !is_active<kGeneralRedactFlag>() ) {
+        return process_stream( message_json, length );
+    }
+
+    // the DOM pipeline compiled for the active features.
+    return ( this->*pipeline_ )( message_json, length );
+}
+
+std::size_t BSMHandler::process_batch( const MessageView* msgs, std::size_t n, ResultSink& sink ) {
+    sink.clear();
+    sink.results.reserve( n );
+
+    std::size_t retained = 0;
+
+    for ( std::size_t i = 0; i < n; ++i ) {
+        ResultSink::Result result{ ResultStatus::SUCCESS, process( msgs[i].data, msgs[i].length ), sink.output.size(), 0 };
+        result.status = result_;
+
+        if ( result.retained ) {
+            // straight from the output buffer; the BSM is not copied into json_ first.
+            sink.output.append( view_.data, view_.length );
+            result.length = view_.length;
+            ++retained;
+        }
+
+        sink.results.push_back( result );
+    }
+
+    return retained;
+}
+
+/**
+ * @brief The output of the streaming mode: every event is written by a RapidJSON writer.
+ */
+class WriterOutput {
+    public:
+        // numbers are converted so they are written as the DOM mode writes them.
+        static const unsigned kParseFlags = rapidjson::kParseDefaultFlags;
+
+        explicit WriterOutput( rapidjson::Writer<rapidjson::StringBuffer>& writer ) :
+            writer_( writer )
+        {}
+
+        bool Null() { return writer_.Null(); }
+        bool Bool( bool b ) { return writer_.Bool( b ); }
+        bool Int( int i ) { return writer_.Int( i ); }
+        bool Uint( unsigned u ) { return writer_.Uint( u ); }
+        bool Int64( int64_t i ) { return writer_.Int64( i ); }
+        bool Uint64( uint64_t u ) { return writer_.Uint64( u ); }
+        bool Double( double d ) { return writer_.Double( d ); }
+        bool RawNumber( const char* str, rapidjson::SizeType length ) { return writer_.RawValue( str, length, rapidjson::kNumberType ); }
+        bool String( const char* str, rapidjson::SizeType length ) { return writer_.String( str, length ); }
+        bool Key( const char* str, rapidjson::SizeType length ) { return writer_.Key( str, length ); }
+        bool StartObject() { return writer_.StartObject(); }
+        bool EndObject( rapidjson::SizeType count ) { return writer_.EndObject( count ); }
+        bool StartArray() { return writer_.StartArray(); }
+        bool EndArray( rapidjson::SizeType count ) { return writer_.EndArray( count ); }
+
+        // a replacement is written instead of the value that spans [start,end) of the input.
+        bool replace_bool( bool b, std::size_t, std::size_t ) { return writer_.Bool( b ); }
+        bool replace_int( int i, std::size_t, std::size_t ) { return writer_.Int( i ); }
+        bool replace_string( const char* str, rapidjson::SizeType length, std::size_t, std::size_t ) { return writer_.String( str, length ); }
+
+    private:
+        rapidjson::Writer<rapidjson::StringBuffer>& writer_;
+};
+
+/**
+ * @brief The output of the patch mode: the events themselves are ignored since the input is copied; only the
+ * replacements are recorded, as splices of the input.
+ */
+class PatchOutput {
+    public:
+        // the input is copied, so only the checked numbers are converted; see StreamFilter::RawNumber.
+        static const unsigned kParseFlags = BSMHandler::flags;
+
+        PatchOutput( std::vector<BSMHandler::Splice>& splices, std::string& text ) :
+            splices_( splices ),
+            text_( text )
+        {}
+
+        bool Null() { return true; }
+        bool Bool( bool ) { return true; }
+        bool Int( int ) { return true; }
+        bool Uint( unsigned ) { return true; }
+        bool Int64( int64_t ) { return true; }
+        bool Uint64( uint64_t ) { return true; }
+        bool Double( double ) { return true; }
+        bool RawNumber( const char*, rapidjson::SizeType ) { return true; }
+        bool String( const char*, rapidjson::SizeType ) { return true; }
+        bool Key( const char*, rapidjson::SizeType ) { return true; }
+        bool StartObject() { return true; }
+        bool EndObject( rapidjson::SizeType ) { return true; }
+        bool StartArray() { return true; }
+        bool EndArray( rapidjson::SizeType ) { return true; }
+
+        // the span starts right after the member's key, so the replacement includes the colon.
+        bool replace_bool( bool b, std::size_t start, std::size_t end ) {
+            return splice( b ? ":true" : ":false", start, end );
+        }
+
+        bool replace_int( int i, std::size_t start, std::size_t end ) {
+            return splice( ":" + std::to_string( i ), start, end );
+        }
+
+        bool replace_string( const char* str, rapidjson::SizeType length, std::size_t start, std::size_t end ) {
+            // the replaced strings (empty, or a hexadecimal redacted id) need no escaping.
+            std::size_t text_start = text_.size();
+            text_.append( ":\"" ).append( str, length ).append( "\"" );
+            splices_.push_back( BSMHandler::Splice{ start, end, text_start, text_.size() - text_start } );
+            return true;
+        }
+
+    private:
+        bool splice( const std::string& replacement, std::size_t start, std::size_t end ) {
+            splices_.push_back( BSMHandler::Splice{ start, end, text_.size(), replacement.size() } );
+            text_ += replacement;
+            return true;
+        }
+
+        std::vector<BSMHandler::Splice>& splices_;
+        std::string& text_;
+};
+
+/**
+ * @brief The SAX handler of the streaming and patch modes. It passes every event to its output, replaces the
+ * sanitized, asn1, id, and size values as they pass, and stops the parser (by returning false) as soon as the BSM is
+ * suppressed or found to be invalid. Member order in the JSON does not matter: the required members are checked when
+ * the parse completes.
+ */
+template<typename Output>
+class BSMHandler::StreamFilter {
+    public:
+        /**
+         * @brief The objects the filter needs to know it is in; everything else is OTHER.
+         */
+        enum Context : uint8_t { ROOT, METADATA, PAYLOAD, DATA, CORE_DATA, POSITION, SIZE, OTHER };
+
+        /**
+         * @brief The members whose values the filter checks or rewrites.
+         */
+        enum Field : uint8_t { NONE, SANITIZED, ASN1, PAYLOAD_TYPE, SPEED, LATITUDE, LONGITUDE, ID, LENGTH, WIDTH };
+
+        // the required members that have been found.
+        static constexpr uint32_t kMetadata     = 0x1 << 0;
+        static constexpr uint32_t kSanitized    = 0x1 << 1;
+        static constexpr uint32_t kPayloadType  = 0x1 << 2;
+        static constexpr uint32_t kPayload      = 0x1 << 3;
+        static constexpr uint32_t kData         = 0x1 << 4;
+        static constexpr uint32_t kCoreData     = 0x1 << 5;
+        static constexpr uint32_t kSpeed        = 0x1 << 6;
+        static constexpr uint32_t kPosition     = 0x1 << 7;
+        static constexpr uint32_t kId           = 0x1 << 8;
+        static constexpr uint32_t kRequired     = 0x1ff;
+
+        /**
+         * @brief Construct a filter for one BSM.
+         *
+         * @param handler the handler whose BSM is updated.
+         * @param output receives the events and the replacements.
+         * @param input the stream being parsed; its position locates the replaced values.
+         */
+        StreamFilter( BSMHandler& handler, Output& output, const rapidjson::MemoryStream& input ) :
+            handler_( handler ),
+            out_( output ),
+            input_( input ),
+            contexts_( handler.stream_contexts_ ),
+            field_{ NONE },
+            child_{ OTHER },
+            skip_{ 0 },
+            key_end_{ 0 },
+            replace_{ NONE },
+            found_{ 0 },
+            latitude_{ false },
+            longitude_{ false },
+            stopped_{ false }
+        {
+            contexts_.clear();
+        }
+
+        /**
+         * @brief Return true if the filter, and not a syntax error, stopped the parser.
+         */
+        bool stopped() const {
+            return stopped_;
+        }
+
+        /**
+         * @brief Return true if all the required members were found.
+         */
+        bool complete() const {
+            return found_ == kRequired;
+        }
+
+        bool Null() {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+            if ( field_ != NONE ) return replace();
+            return out_.Null();
+        }
+
+        bool Bool( bool b ) {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+
+            if ( field_ == SANITIZED ) {
+                found_ |= kSanitized;
+                field_ = NONE;
+                return b ? out_.Bool( b ) : out_.replace_bool( true, key_end_, input_.Tell() );
+            }
+
+            if ( field_ != NONE ) return replace();
+            return out_.Bool( b );
+        }
+
+        bool Int( int i ) {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+            if ( field_ != NONE ) return replace();
+            return out_.Int( i );
+        }
+
+        bool Uint( unsigned u ) {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+            if ( field_ != NONE ) return replace();
+            return out_.Uint( u );
+        }
+
+        bool Int64( int64_t i ) {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+            if ( field_ != NONE ) return replace();
+            return out_.Int64( i );
+        }
+
+        bool Uint64( uint64_t u ) {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+            if ( field_ != NONE ) return replace();
+            return out_.Uint64( u );
+        }
+
+        bool Double( double d ) {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+
+            switch ( field_ ) {
+                case SPEED:
+                    found_ |= kSpeed;
+                    field_ = NONE;
+                    handler_.bsm_.set_velocity( d );
+
+                    if ( handler_.is_active<kVelocityFilterFlag>() && handler_.vf_.suppress( d ) ) {
+                        return stop( ResultStatus::SPEED );
+                    }
+                    break;
+
+                case LATITUDE:
+                    latitude_ = true;
+                    field_ = NONE;
+                    handler_.bsm_.set_latitude( d );
+                    break;
+
+                case LONGITUDE:
+                    longitude_ = true;
+                    field_ = NONE;
+                    handler_.bsm_.set_longitude( d );
+                    break;
+
+                default:
+                    if ( field_ != NONE ) return replace();
             }
 
-        }  else if (entity_ptr->get_type() == "circle") {
-            circle_ptr = std::static_pointer_cast<const geo::Circle>(entity_ptr);
+            return out_.Double( d );
+        }
+
+        bool RawNumber( const char* str, rapidjson::SizeType length, bool ) {
+            if ( skip_ > 0 ) return true;
+
+            switch ( field_ ) {
+                case SPEED:
+                case LATITUDE:
+                case LONGITUDE:
+                    // the checked values must be doubles, as in the DOM mode: a fraction or an exponent.
+                    double d;
+                    if ( is_double( str, length ) && double_utilities::to_double( str, length, d ) ) return Double( d );
+                    break;
+
+                default:
+                    break;
+            }
+
+            if ( !value() ) return false;
+            if ( field_ != NONE ) return replace();
+            return out_.RawNumber( str, length );
+        }
+
+        bool String( const char* str, rapidjson::SizeType length, bool ) {
+            if ( skip_ > 0 ) return true;
+            if ( !value() ) return false;
+
+            if ( field_ == PAYLOAD_TYPE ) {
+                found_ |= kPayloadType;
+                field_ = NONE;
+
+                handler_.payload_kind_ = handler_.payloads_.find( str, length );
+
+                if ( handler_.payload_kind_ != PayloadKind::BSM ) {
+                    // only BSMs are filtered here; see stream_stopped.
+                    return stop( ResultStatus::MISSING );
+                }
+
+            } else if ( field_ == ID ) {
+                found_ |= kId;
+                field_ = NONE;
+
+                std::string id{ str, length };
 
-            if (circle_ptr->contains(bsm)) {
+                if ( handler_.is_active<kIdRedactFlag>() ) {
+                    handler_.bsm_.set_original_id( id );
+                    handler_.idr_( id );
+                }
+
+                handler_.bsm_.set_id( id );
+
+                if ( id.size() != length || id.compare( 0, length, str, length ) != 0 ) {
+                    return out_.replace_string( id.data(), static_cast<rapidjson::SizeType>( id.size() ), key_end_, input_.Tell() );
+                }
+
+            } else if ( field_ != NONE ) {
+                return replace();
+            }
+
+            return out_.String( str, length );
+        }
+
+        bool StartObject() {
+            if ( skip_ > 0 ) {
+                ++skip_;
                 return true;
             }
 
-        } else  if (entity_ptr->get_type() == "grid") {
-            grid_ptr = std::static_pointer_cast<const geo::Grid>(entity_ptr); 
+            if ( contexts_.empty() ) {
+                // the BSM must be an object.
+                contexts_.push_back( ROOT );
+                return out_.StartObject();
+            }
+
+            if ( field_ != NONE ) return skip();
+
+            switch ( child_ ) {
+                case METADATA:  found_ |= kMetadata; break;
+                case PAYLOAD:   found_ |= kPayload; break;
+                case DATA:      found_ |= kData; break;
+                case CORE_DATA: found_ |= kCoreData; break;
+                case POSITION:  found_ |= kPosition; latitude_ = longitude_ = false; break;
+                default: break;
+            }
+
+            contexts_.push_back( child_ );
+            child_ = OTHER;
+            return out_.StartObject();
+        }
+
+        bool Key( const char* str, rapidjson::SizeType length, bool ) {
+            if ( skip_ > 0 ) return true;
+
+            field_ = NONE;
+            child_ = OTHER;
+
+            switch ( contexts_.back() ) {
+                case ROOT:
+                    if ( is( str, length, "metadata" ) ) child_ = METADATA;
+                    else if ( is( str, length, "payload" ) ) child_ = PAYLOAD;
+                    break;
+
+                case METADATA:
+                    if ( is( str, length, "sanitized" ) ) field_ = SANITIZED;
+                    else if ( is( str, length, "asn1" ) ) field_ = ASN1;
+                    else if ( is( str, length, "payloadType" ) ) field_ = PAYLOAD_TYPE;
+                    break;
+
+                case PAYLOAD:
+                    if ( is( str, length, "data" ) ) child_ = DATA;
+                    break;
+
+                case DATA:
+                    if ( is( str, length, "coreData" ) ) child_ = CORE_DATA;
+                    break;
+
+                case CORE_DATA:
+                    if ( is( str, length, "speed" ) ) field_ = SPEED;
+                    else if ( is( str, length, "id" ) ) field_ = ID;
+                    else if ( is( str, length, "position" ) ) child_ = POSITION;
+                    else if ( is( str, length, "size" ) && handler_.is_active<kSizeRedactFlag>() ) child_ = SIZE;
+                    break;
+
+                case POSITION:
+                    if ( is( str, length, "latitude" ) ) field_ = LATITUDE;
+                    else if ( is( str, length, "longitude" ) ) field_ = LONGITUDE;
+                    break;
+
+                case SIZE:
+                    if ( is( str, length, "length" ) ) field_ = LENGTH;
+                    else if ( is( str, length, "width" ) ) field_ = WIDTH;
+                    break;
+
+                default:
+                    break;
+            }
+
+            // a replaced value spans from here to its end.
+            key_end_ = input_.Tell();
+            return out_.Key( str, length );
+        }
+
+        bool EndObject( rapidjson::SizeType count ) {
+            if ( skip_ > 0 ) return unskip();
+
+            if ( contexts_.back() == POSITION ) {
+                if ( !latitude_ || !longitude_ ) {
+                    return stop( ResultStatus::MISSING );
+                }
+
+                if ( handler_.is_active<kGeofenceFilterFlag>() && !handler_.isWithinEntity( handler_.bsm_ ) ) {
+                    return stop( ResultStatus::GEOPOSITION );
+                }
+            }
+
+            contexts_.pop_back();
+            return out_.EndObject( count );
+        }
 
-            if (grid_ptr->contains(bsm)) {
+        bool StartArray() {
+            if ( skip_ > 0 ) {
+                ++skip_;
                 return true;
             }
 
+            if ( contexts_.empty() ) return stop( ResultStatus::PARSE );
+            if ( field_ != NONE ) return skip();
+
+            contexts_.push_back( OTHER );
+            child_ = OTHER;
+            return out_.StartArray();
+        }
+
+        bool EndArray( rapidjson::SizeType count ) {
+            if ( skip_ > 0 ) return unskip();
+
+            contexts_.pop_back();
+            return out_.EndArray( count );
+        }
+
+    private:
+        /**
+         * @brief Predicate indicating whether a parsed string equals a member name.
+         */
+        template<std::size_t N>
+        static bool is( const char* str, rapidjson::SizeType length, const char (&name)[N] ) {
+            return length == N - 1 && std::memcmp( str, name, N - 1 ) == 0;
+        }
+
+        /**
+         * @brief Predicate indicating whether the text of a number would be parsed as a double.
+         */
+        static bool is_double( const char* str, rapidjson::SizeType length ) {
+            for ( const char* end = str + length; str < end; ++str ) {
+                if ( *str == '.' || *str == 'e' || *str == 'E' ) return true;
+            }
+
+            return false;
+        }
+
+        /**
+         * @brief Check a scalar value is allowed here; the BSM itself must be an object.
+         */
+        bool value() {
+            if ( contexts_.empty() ) return stop( ResultStatus::PARSE );
+            child_ = OTHER;
+            return true;
+        }
+
+        /**
+         * @brief Handle a scalar value of a checked field that is not of the expected type: the rewritten fields are
+         * replaced and the others make the BSM invalid.
+         *
+         * @return false if the parser must stop.
+         */
+        bool replace() {
+            Field field = field_;
+            field_ = NONE;
+
+            return replace( field, input_.Tell() );
+        }
+
+        bool replace( Field field, std::size_t end ) {
+            switch ( field ) {
+                case ASN1:
+                    return out_.replace_string( "", 0, key_end_, end );
+
+                case LENGTH:
+                case WIDTH:
+                    return out_.replace_int( 0, key_end_, end );
+
+                default:
+                    return stop( ResultStatus::OTHER );
+            }
+        }
+
+        /**
+         * @brief Start skipping an object or array value; a rewritten field is replaced when the value ends and any
+         * other checked field makes the BSM invalid.
+         */
+        bool skip() {
+            if ( field_ != ASN1 && field_ != LENGTH && field_ != WIDTH ) return stop( ResultStatus::OTHER );
+
+            replace_ = field_;
+            field_ = NONE;
+            skip_ = 1;
+            return true;
+        }
+
+        /**
+         * @brief Leave one level of a skipped value; the replacement is output after the last one.
+         */
+        bool unskip() {
+            if ( --skip_ > 0 ) return true;
+            return replace( replace_, input_.Tell() );
+        }
+
+        bool stop( ResultStatus result ) {
+            handler_.result_ = result;
+            stopped_ = true;
+            return false;
+        }
+
+        BSMHandler& handler_;
+        Output& out_;
+        const rapidjson::MemoryStream& input_;
+        std::vector<uint8_t>& contexts_;    ///< The open objects and arrays as Context values.
+        Field field_;                       ///< The checked field whose value comes next.
+        Context child_;                     ///< The context of the object value that comes next.
+        unsigned skip_;                     ///< The depth inside a replaced value; its events are dropped.
+        std::size_t key_end_;               ///< The input position just after the last key.
+        Field replace_;                     ///< The field of the skipped value.
+        uint32_t found_;                    ///< The required members found.
+        bool latitude_;                     ///< The position had a latitude.
+        bool longitude_;                    ///< The position had a longitude.
+        bool stopped_;                      ///< The filter stopped the parser.
+};
+
+bool BSMHandler::process_stream( const char* message_json, std::size_t length ) {
+    clear_output();
+    result_ = ResultStatus::SUCCESS;
+
+    payload_kind_ = PayloadKind::UNSUPPORTED;
+
+    // parsing can stop before the id or position are read; do not log the previous BSM's values.
+    bsm_.reset();
+
+    rapidjson::MemoryStream ms( message_json, length );
+
+    if ( is_active<kPatchOutputFlag>() ) {
+        splices_.clear();
+        splice_text_.clear();
+
+        PatchOutput output{ splices_, splice_text_ };
+        if ( !filter_stream( ms, output ) ) return stream_stopped( message_json, length );
+
+        // copy the input around the replaced values.
+        json_.clear();
+        json_.reserve( length + splice_text_.size() );
+
+        std::size_t position = 0;
+        for ( const auto& splice : splices_ ) {
+            json_.append( message_json + position, splice.start - position );
+            json_.append( splice_text_, splice.text_start, splice.text_length );
+            position = splice.end;
         }
+
+        json_.append( message_json + position, length - position );
+
+        view_ = JsonView{ json_.data(), json_.size() };
+        finalized_ = true;
+
+    } else {
+        output_buffer_.Clear();
+        output_writer_.Reset( output_buffer_ );
+
+        WriterOutput output{ output_writer_ };
+        if ( !filter_stream( ms, output ) ) return stream_stopped( message_json, length );
+
+        view_ = JsonView{ output_buffer_.GetString(), output_buffer_.GetSize() };
     }
-    return false;
+
+    return true;
 }
 
-bool BSMHandler::process( const std::string& message_json ) {
+bool BSMHandler::stream_stopped( const char* message_json, std::size_t length ) {
+    if ( payload_kind_ != PayloadKind::PASS_THROUGH ) return false;
+
+    return ( this->*pipeline_ )( message_json, length );
+}
+
+template<typename Output>
+bool BSMHandler::filter_stream( rapidjson::MemoryStream& input, Output& output ) {
+    StreamFilter<Output> filter{ *this, output, input };
+    rapidjson::EncodedInputStream<rapidjson::UTF8<>, rapidjson::MemoryStream> is( input );
+
+    if ( stream_reader_.Parse<Output::kParseFlags>( is, filter ).IsError() ) {
+        // the filter records why it stopped the parser.
+        if ( !filter.stopped() ) {
+            result_ = ResultStatus::PARSE;
+        }
+
+        return false;
+    }
+
+    if ( !filter.complete() ) {
+        result_ = ResultStatus::MISSING;
+
+        return false;
+    }
+
+    return true;
+}
+
+// One DOM pipeline for each combination of the feature flags, indexed by pipeline_index.
+#define CVDP_PIPELINE(index) &BSMHandler::process_document<BSMHandler::pipeline_mask( index )>
+
+const BSMHandler::Pipeline BSMHandler::pipelines_[ BSMHandler::kPipelineCount ] = {
+    CVDP_PIPELINE(0),  CVDP_PIPELINE(1),  CVDP_PIPELINE(2),  CVDP_PIPELINE(3),
+    CVDP_PIPELINE(4),  CVDP_PIPELINE(5),  CVDP_PIPELINE(6),  CVDP_PIPELINE(7),
+    CVDP_PIPELINE(8),  CVDP_PIPELINE(9),  CVDP_PIPELINE(10), CVDP_PIPELINE(11),
+    CVDP_PIPELINE(12), CVDP_PIPELINE(13), CVDP_PIPELINE(14), CVDP_PIPELINE(15),
+    CVDP_PIPELINE(16), CVDP_PIPELINE(17), CVDP_PIPELINE(18), CVDP_PIPELINE(19),
+    CVDP_PIPELINE(20), CVDP_PIPELINE(21), CVDP_PIPELINE(22), CVDP_PIPELINE(23),
+    CVDP_PIPELINE(24), CVDP_PIPELINE(25), CVDP_PIPELINE(26), CVDP_PIPELINE(27),
+    CVDP_PIPELINE(28), CVDP_PIPELINE(29), CVDP_PIPELINE(30), CVDP_PIPELINE(31)
+};
+
+#undef CVDP_PIPELINE
+
+void BSMHandler::select_pipeline() {
+    pipeline_ = pipelines_[ pipeline_index( activated_ ) ];
+}
+
+template<uint32_t MASK>
+bool BSMHandler::process_document( const char* message_json, std::size_t length ) {
     double speed = 0.0;
     double latitude = 0.0;
     double longitude = 0.0;
     std::string id;
     
     // JMC: Attempt to fix memory leak; build and destroy JSON object each time to ensure memory is reclaimed.
-    rapidjson::Document document;
+    // The previous message's document is gone, so its memory is reclaimed by resetting the arena instead of freeing
+    // it; the new document's values and parse stack are allocated from the arena.
+    arena_.reset();
+    JsonArena::Document document{ &arena_.values(), JsonArena::kStackCapacity, &arena_.stack() };
 
-    finalized_ = false;
+    clear_output();
     result_ = ResultStatus::SUCCESS;
+    payload_kind_ = PayloadKind::UNSUPPORTED;
     
     // create the DOM
     // check for errors
-    if (document.Parse(message_json.c_str()).HasParseError()) {
+    if (document.Parse(message_json, length).HasParseError()) {
         result_ = ResultStatus::PARSE;
 
         return false;
@@ -162,165 +1011,163 @@ bool BSMHandler::process( const std::string& message_json ) {
         return false;
     }
 
-    if (!document.HasMember("metadata")) {
+    // one walk over each object on the fixed path finds everything checked or redacted below.
+    BSMMembers members;
+    members.resolve( document );
+
+    if (!members.metadata) {
         result_ = ResultStatus::MISSING;
 
         return false;
     }
 
-    rapidjson::Value& metadata = document["metadata"];
-
     // switch sanitized flag
-    if (!metadata.HasMember("sanitized")) {
+    if (!members.sanitized) {
         result_ = ResultStatus::MISSING;
 
         return false;
     }
 
-    if (!metadata["sanitized"].IsBool()) {
+    if (!members.sanitized->IsBool()) {
         result_ = ResultStatus::OTHER;
 
         return false;
     }
 
-    metadata["sanitized"] = true;
+    *members.sanitized = true;
     
-    if (metadata.HasMember("asn1")) {
-        metadata["asn1"].SetString("", document.GetAllocator());
+    if (members.asn1) {
+        members.asn1->SetString("", document.GetAllocator());
     }
 
     // get the payload type
-    if (!metadata.HasMember("payloadType")) {
+    if (!members.payload_type) {
         result_ = ResultStatus::MISSING;
 
         return false;
     }
 
-    if (!metadata["payloadType"].IsString()) {
+    if (!members.payload_type->IsString()) {
         result_ = ResultStatus::OTHER;
 
         return false;
     }
 
-    std::string payload_type_str = metadata["payloadType"].GetString();
-
-    if (payload_type_str == "us.dot.its.jpo.ode.model.OdeBsmPayload") {
-        if (!document.HasMember("payload")) {
-            result_ = ResultStatus::MISSING;
-
-            return false;
-        }
-    
-        rapidjson::Value& payload = document["payload"];
+    payload_kind_ = payloads_.find(members.payload_type->GetString(), members.payload_type->GetStringLength());
 
+    if (payload_kind_ == PayloadKind::BSM) {
         // handle BSM payload
-        if (!payload.HasMember("data")) {
+        if (!members.payload || !members.data || !members.core_data) {
             result_ = ResultStatus::MISSING;
 
             return false;
         }
 
-        rapidjson::Value& data = payload["data"];
-
-        if (!data.HasMember("coreData")) {
-            result_ = ResultStatus::MISSING;
-
-            return false;
-        }
-
-        rapidjson::Value& core_data = data["coreData"];
-
-        if (!core_data.HasMember("speed")) {
+        if (!members.speed) {
             result_ = ResultStatus::MISSING;
 
             return false;
         }
         
-        if (!core_data["speed"].IsDouble()) {
+        if (!members.speed->IsDouble()) {
             result_ = ResultStatus::OTHER;
 
             return false;
         }
 
-        speed = core_data["speed"].GetDouble();
+        speed = members.speed->GetDouble();
         bsm_.set_velocity(speed);
 
-        if (is_active<kVelocityFilterFlag>() && vf_.suppress(speed)) {
+        if ((MASK & kVelocityFilterFlag) && vf_.suppress(speed)) {
             result_ = ResultStatus::SPEED;
         }
 
-        if (!core_data.HasMember("position")) {
+        if (!members.position) {
             result_ = ResultStatus::MISSING;
 
             return false;
         }
 
-        rapidjson::Value& position = core_data["position"];
-
-        if (!position.HasMember("latitude") || !position.HasMember("longitude")) {
+        if (!members.latitude || !members.longitude) {
             result_ = ResultStatus::MISSING;
 
             return false;
         }
 
-        if (!position["latitude"].IsDouble() || !position["longitude"].IsDouble()) {
+        if (!members.latitude->IsDouble() || !members.longitude->IsDouble()) {
             result_ = ResultStatus::OTHER;
 
             return false;
         }
         
-        latitude = position["latitude"].GetDouble();
-        longitude = position["longitude"].GetDouble();
+        latitude = members.latitude->GetDouble();
+        longitude = members.longitude->GetDouble();
 
         bsm_.set_latitude(latitude); 
         bsm_.set_longitude(longitude); 
 
-        if (is_active<kGeofenceFilterFlag>() && !isWithinEntity(bsm_)) {
+        // a BSM already suppressed by its speed is not looked up in the geofence when discarding fast.
+        if ((MASK & kGeofenceFilterFlag) && !discarded() && !isWithinEntity(bsm_)) {
             result_ = ResultStatus::GEOPOSITION;
         }
 
-        if (!core_data.HasMember("id")) {
+        if (!members.id) {
             result_ = ResultStatus::MISSING;
 
             return false;
         }
 
-        if (!core_data["id"].IsString()) {
+        if (!members.id->IsString()) {
             result_ = ResultStatus::OTHER;
 
             return false;
         }
 
-        id = core_data["id"].GetString();
+        id.assign(members.id->GetString(), members.id->GetStringLength());
 
-        if (is_active<kIdRedactFlag>()) {
+        if (MASK & kIdRedactFlag) {
+            // the id is still redacted for a discarded BSM since it is logged.
             bsm_.set_original_id(id);
             idr_(id);
 
-            core_data["id"].SetString(id.c_str(), static_cast<rapidjson::SizeType>(id.size()), document.GetAllocator());
+            if (!discarded()) {
+                members.id->SetString(id.c_str(), static_cast<rapidjson::SizeType>(id.size()), document.GetAllocator());
+            }
         }
 
         bsm_.set_id(id);
 
+        if (discarded()) {
+            // the BSM will not be published; bsm_ has everything the suppression log needs.
+            return false;
+        }
+
         // Check for BSM size.  
         // Size is a special case; if it's not included, then we do 
         // NOT return an error/suppress
-        if (core_data.HasMember("size") && is_active<kSizeRedactFlag>()) {
-            // size included
-            rapidjson::Value& size = core_data["size"];
-          
-            if (size.HasMember("length")) {
+        if ((MASK & kSizeRedactFlag) && members.size) {
+            if (members.length) {
                 // length included; redact
-                size["length"] = 0; 
+                *members.length = 0; 
             } 
 
-            if (size.HasMember("width")) {
+            if (members.width) {
                 // width included; redact
-                size["width"] = 0; 
+                *members.width = 0; 
             } 
         }
 
-        handleGeneralRedaction(document); // uses fieldsToRedact.txt
+        if (MASK & kGeneralRedactFlag) {
+            handleGeneralRedaction(document); // uses fieldsToRedact.txt
+        }
+    }
+    else if (payload_kind_ == PayloadKind::PASS_THROUGH) {
+        // not a BSM: nothing to filter and no BSM values to log.
+        bsm_.reset();
+
+        if (MASK & kGeneralRedactFlag) {
+            handleGeneralRedaction(document);
+        }
     }
     else {
         // Unsupported payload type
@@ -331,18 +1178,17 @@ bool BSMHandler::process( const std::string& message_json ) {
     // JMC: Moving this here to finalize the json string instead of in get_json()
     // JMC: Go ahead and write out the BSM in redacted form using the document that we built in
     // JMC: this method.
-    rapidjson::StringBuffer buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-    document.Accept(writer);
-    json_ = buffer.GetString();
-
-    // TODO: if we keep this model, this variable serves no purpose.
-    finalized_ = true;
+    // the buffer and writer keep their capacity from one BSM to the next; the output stays in the buffer and is only
+    // copied into json_ if get_json is called.
+    output_buffer_.Clear();
+    output_writer_.Reset( output_buffer_ );
+    document.Accept( output_writer_ );
+    view_ = JsonView{ output_buffer_.GetString(), output_buffer_.GetSize() };
     
     return result_ == ResultStatus::SUCCESS;
 }
 
-void BSMHandler::handleGeneralRedaction(rapidjson::Document& document) {
+void BSMHandler::handleGeneralRedaction(JsonArena::Document& document) {
     if (is_active<kGeneralRedactFlag>()) {
         for (std::string memberPath : rpm.getFields()) {
             bool memberRedacted = rapidjsonRedactor.redactMemberByPath(document, memberPath.c_str());
@@ -352,24 +1198,40 @@ void BSMHandler::handleGeneralRedaction(rapidjson::Document& document) {
         }
 
         // attempt to store the redacted coreData and partII in the BSM object
-        if (document["payload"]["data"].HasMember("coreData")) {
-            std::string coreDataString = rapidjsonRedactor.stringifyValue(document["payload"]["data"]["coreData"]);
+        rapidjson::Value* data = find_member( find_member( &document, kPayloadName ), kDataName );
+
+        rapidjson::Value* core_data = find_member( data, kCoreDataName );
+        if (core_data) {
+            std::string coreDataString = rapidjsonRedactor.stringifyValue(*core_data);
             bsm_.set_coreData(coreDataString);
         }
 
-        if (document["payload"]["data"].HasMember("partII")) {
-            std::string partIIString = rapidjsonRedactor.stringifyValue(document["payload"]["data"]["partII"]);
+        rapidjson::Value* part_ii = find_member( data, kPartIIName );
+        if (part_ii) {
+            std::string partIIString = rapidjsonRedactor.stringifyValue(*part_ii);
             bsm_.set_partII(partIIString);
         }
     }
 }
 
+bool BSMHandler::discarded() {
+    return is_active<kFastDiscardFlag>() && result_ != ResultStatus::SUCCESS;
+}
+
+const PayloadKind BSMHandler::get_payload_kind() const {
+    return payload_kind_;
+}
+
+const PayloadRegistry& BSMHandler::get_payload_registry() const {
+    return payloads_;
+}
+
 const BSMHandler::ResultStatus BSMHandler::get_result() const {
     return result_;
 }
 
 const std::string& BSMHandler::get_result_string() const {
-    return result_string_map[ result_ ];
+    return result_string_map.at( result_ );
 }
 
 BSM& BSMHandler::get_bsm() {
@@ -389,9 +1251,20 @@ const std::string& BSMHandler::get_json() {
     // JMC: The json_ string is set in the process method now to avoid the memory leak in RapidJSON.
     // IMPORTANT: Ensure you call the process method prior to attempting to call this method.
     // IMPORTANT: This is what happens in the main loop of the ppm code.
+    // The process method writes the output into its buffer; it is copied into json_ on the first request.
+    if ( !finalized_ ) {
+        json_.assign( view_.data, view_.length );
+        view_ = JsonView{ json_.data(), json_.size() };
+        finalized_ = true;
+    }
+
     return json_;
 }
 
+BSMHandler::JsonView BSMHandler::get_json_view() const {
+    return view_;
+}
+
 std::string::size_type BSMHandler::get_bsm_buffer_size() {
     // JMC: how we are using this it is always finalized now that I moved the document object.
     // if ( !finalized_ ) {
@@ -401,7 +1274,25 @@ std::string::size_type BSMHandler::get_bsm_buffer_size() {
     // JMC: The json_ string is set in the process method now to avoid the memory leak in RapidJSON.
     // IMPORTANT: Ensure you call the process method prior to attempting to call this method.
     // IMPORTANT: This is what happens in the main loop of the ppm code.
-    return json_.size();
+    return view_.length;
+}
+
+void BSMHandler::swap_json( std::string& buffer ) {
+    if ( finalized_ ) {
+        json_.swap( buffer );
+    } else {
+        buffer.assign( view_.data, view_.length );
+    }
+
+    // the output has been handed over.
+    json_.clear();
+    view_ = JsonView{ json_.data(), 0 };
+    finalized_ = true;
+}
+
+void BSMHandler::clear_output() {
+    view_ = JsonView{ "", 0 };
+    finalized_ = false;
 }
 
 const double BSMHandler::get_box_extension() const
@@ -0,0 +1,46 @@
+#include "bufferPool.hpp"
+
+constexpr std::size_t BufferPool::kDefaultMaxIdle;
+
+BufferPool::BufferPool( std::size_t max_idle ) :
+    max_idle_{ max_idle },
+    idle_{},
+    outstanding_{ 0 }
+{}
+
+BufferPool::Buffer* BufferPool::acquire() {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    ++outstanding_;
+
+    if ( idle_.empty() ) {
+        return new Buffer{ std::string{}, -1, -1 };
+    }
+
+    Buffer* buffer = idle_.back().release();
+    idle_.pop_back();
+    return buffer;
+}
+
+void BufferPool::release( Buffer* buffer ) {
+    if ( !buffer ) return;
+
+    std::unique_ptr<Buffer> owned{ buffer };
+    owned->json.clear();
+
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    --outstanding_;
+
+    if ( idle_.size() < max_idle_ ) {
+        idle_.push_back( std::move( owned ) );
+    }
+}
+
+std::size_t BufferPool::idle() const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    return idle_.size();
+}
+
+std::size_t BufferPool::outstanding() const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    return outstanding_;
+}
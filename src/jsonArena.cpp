@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#include "jsonArena.hpp"
+
+constexpr std::size_t JsonArena::kDefaultSize;
+constexpr std::size_t JsonArena::kDefaultHighWater;
+constexpr std::size_t JsonArena::kStackSize;
+constexpr std::size_t JsonArena::kMinimumSize;
+constexpr std::size_t JsonArena::kStackCapacity;
+
+JsonArena::JsonArena( std::size_t size, std::size_t high_water ) :
+    high_water_{ std::max( size, high_water ) },
+    value_buffer_( std::max( size, kMinimumSize ) ),
+    stack_buffer_( kStackSize ),
+    value_pool_{ new Allocator{ value_buffer_.data(), value_buffer_.size() } },
+    stack_pool_{ new Allocator{ stack_buffer_.data(), stack_buffer_.size() } }
+{}
+
+JsonArena::Allocator& JsonArena::values() {
+    return *value_pool_;
+}
+
+JsonArena::Allocator& JsonArena::stack() {
+    return *stack_pool_;
+}
+
+void JsonArena::reset() {
+    reset( value_buffer_, value_pool_ );
+    reset( stack_buffer_, stack_pool_ );
+}
+
+std::size_t JsonArena::size() const {
+    return value_buffer_.size();
+}
+
+void JsonArena::reset( std::vector<char>& buffer, std::unique_ptr<Allocator>& pool ) {
+    // the pool's chunk headers and alignment take part of the buffer.
+    std::size_t needed = pool->Size() + 1024;
+
+    if ( pool->Capacity() <= buffer.size() || buffer.size() >= high_water_ ) {
+        // it fit, or it is not allowed to grow: keep the buffer and free any spilled chunks.
+        pool->Clear();
+        return;
+    }
+
+    std::size_t size = buffer.size();
+    while ( size < needed && size < high_water_ ) size *= 2;
+
+    // the old pool frees its spilled chunks before its buffer is replaced.
+    pool.reset();
+    buffer.assign( std::min( size, high_water_ ), 0 );
+    pool.reset( new Allocator{ buffer.data(), buffer.size() } );
+}
@@ -78,10 +78,6 @@ bool KafkaConsumer::ode_topic_available(const std::string& topic, std::shared_pt
 }
 
 RdKafka::ErrorCode KafkaConsumer::msg_consume(RdKafka::Message* message, void* opaque, BSMHandler& handler) {
-    // payload is a void *
-    // len is a size_t
-    std::string payload(static_cast<const char*>(message->payload()), message->len());
-
     switch (message->err()) {
         case RdKafka::ERR__TIMED_OUT:
             break;
@@ -113,7 +109,8 @@ RdKafka::ErrorCode KafkaConsumer::msg_consume(RdKafka::Message* message, void* o
                 logger->info("Key: " + *message->key());
             }
 
-            if ( handler.process( payload ) ) {
+            // parse straight out of the librdkafka buffer; payload is a void * and len is a size_t.
+            if ( handler.process( static_cast<const char*>(message->payload()), message->len() ) ) {
                 return RdKafka::ERR_NO_ERROR;
             } else {
                 return RdKafka::ERR_INVALID_MSG;
@@ -532,7 +529,9 @@ usage:
                     logger->info(ss.str());
 
                     // if we still have a message in the handler, we send it back out to the producer we have made above.
-                    status = producer->produce(topic, partition, RdKafka::Producer::RK_MSG_COPY, (void *)handler.get_json().c_str(), handler.get_bsm_buffer_size(), NULL, NULL);
+                    // librdkafka copies the payload, so it is produced straight from the handler's output buffer.
+                    BSMHandler::JsonView json = handler.get_json_view();
+                    status = producer->produce(topic, partition, RdKafka::Producer::RK_MSG_COPY, const_cast<char *>(json.data), json.length, NULL, NULL);
                     if (status != RdKafka::ERR_NO_ERROR) {
                         logger->error("% Produce failed: " + RdKafka::err2str( status ));
                     } 
@@ -0,0 +1,96 @@
+#include "offsetTracker.hpp"
+
+#include <algorithm>
+
+OffsetTracker::OffsetTracker() :
+    partitions_{},
+    pending_{ 0 },
+    failed_{ false }
+{}
+
+void OffsetTracker::consumed( int32_t partition, int64_t offset ) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+
+    auto result = partitions_.insert( std::make_pair( partition, PartitionState{ {}, -1, false } ) );
+    result.first->second.offsets.emplace_back( offset, false );
+    ++pending_;
+}
+
+void OffsetTracker::completed( int32_t partition, int64_t offset ) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+
+    auto search = partitions_.find( partition );
+    if ( search == partitions_.end() ) return;
+
+    PartitionState& state = search->second;
+
+    // the offsets are sorted but need not be contiguous, e.g., after compaction.
+    auto it = std::lower_bound( state.offsets.begin(), state.offsets.end(), std::make_pair( offset, false ) );
+    if ( it == state.offsets.end() || it->first != offset ) return;
+
+    it->second = true;
+
+    // advance past the contiguous completed prefix.
+    while ( !state.offsets.empty() && state.offsets.front().second ) {
+        state.commit = state.offsets.front().first + 1;
+        state.advanced = true;
+        state.offsets.pop_front();
+        --pending_;
+    }
+}
+
+void OffsetTracker::failed( int32_t partition, int64_t offset ) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+
+    auto search = partitions_.find( partition );
+    if ( search == partitions_.end() ) return;
+
+    const auto& offsets = search->second.offsets;
+    auto it = std::lower_bound( offsets.begin(), offsets.end(), std::make_pair( offset, false ) );
+    if ( it == offsets.end() || it->first != offset ) return;
+
+    // the offset stays incomplete; the restarted consumer delivers it, and every offset after it, again.
+    failed_ = true;
+}
+
+bool OffsetTracker::rewind_needed() const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    return failed_;
+}
+
+OffsetTracker::CommitList OffsetTracker::take_commits() {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+
+    CommitList commits;
+    for ( auto& entry : partitions_ ) {
+        if ( entry.second.advanced ) {
+            commits.emplace_back( entry.first, entry.second.commit );
+            entry.second.advanced = false;
+        }
+    }
+
+    return commits;
+}
+
+void OffsetTracker::erase( int32_t partition ) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+
+    auto search = partitions_.find( partition );
+    if ( search == partitions_.end() ) return;
+
+    pending_ -= search->second.offsets.size();
+    partitions_.erase( search );
+}
+
+void OffsetTracker::clear() {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+
+    partitions_.clear();
+    pending_ = 0;
+    failed_ = false;
+}
+
+std::size_t OffsetTracker::pending() const {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    return pending_;
+}
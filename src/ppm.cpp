@@ -51,6 +51,7 @@
 
 #include "ppm.hpp"
 #include "spdlog/spdlog.h"
+#include <algorithm>
 #include <csignal>
 #include <chrono>
 #include <thread>
@@ -85,14 +86,40 @@ void PPM::sigterm (int sig) {
 PPM::PPM( const std::string& name, const std::string& description ) :
     Tool{ name, description },
     exit_eof{true},
-    eof_cnt{0},
-    partition_cnt{1},
+    partition_cnt{0},
+    assigned_partitions{},
     bsm_recv_count{0},
     bsm_send_count{0},
     bsm_filt_count{0},
     bsm_recv_bytes{0},
     bsm_send_bytes{0},
+    bsm_fail_count{0},
+    bsm_inflight_count{0},
+    bsm_pending_count{0},
     bsm_filt_bytes{0},
+    worker_count{1},
+    worker_queue_size{1024},
+    batch_size{1},
+    batch_linger{0},
+    stats_interval{60000},
+    forward_keys{false},
+    max_inflight{10000},
+    manual_commit{false},
+    commit_interval{1000},
+    offsets{},
+    transactional{false},
+    txn_size{1000},
+    txn_interval{100},
+    txn_timeout{30000},
+    txn_open{false},
+    txn_count{0},
+    txn_last{},
+    txn_aborted{false},
+    txn_commit_requested{false},
+    txn_commits{0},
+    workers{},
+    publisher{},
+    batches{},
     pconf{},
     brokers{"localhost"},
     partition{RdKafka::Topic::PARTITION_UA},
@@ -103,7 +130,13 @@ PPM::PPM( const std::string& name, const std::string& description ) :
     consumed_topic{},
     conf{nullptr},
     tconf{nullptr},
-    qptr{},
+    kafka_settings{},
+    producer_conf{nullptr},
+    consumer_conf{nullptr},
+    geofence{},
+    output_buffers{},
+    delivery_report{ *this },
+    rebalance_handler{ *this },
     consumer{},
     consumer_timeout{500},
     producer{},
@@ -119,6 +152,8 @@ PPM::~PPM()
     // free raw librdkafka pointers.
     if (tconf) delete tconf;
     if (conf) delete conf;
+    if (producer_conf) delete producer_conf;
+    if (consumer_conf) delete consumer_conf;
 
     // TODO: This librdkafka item seems wrong...
     RdKafka::wait_destroyed(5000);    // pause to let RdKafka reclaim resources.
@@ -242,6 +277,29 @@ void PPM::print_configuration() const
     }
 }
 
+RdKafka::Conf::ConfResult PPM::set_kafka(const std::string& name, const std::string& value, std::string& error_string) {
+    RdKafka::Conf::ConfResult result = conf->set(name, value, error_string);
+    if ( result == RdKafka::Conf::CONF_OK ) {
+        kafka_settings.emplace_back( name, value );
+    }
+
+    return result;
+}
+
+RdKafka::Conf* PPM::create_role_conf(const std::string& skipped) const {
+    std::string error_string;
+    RdKafka::Conf* role_conf = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
+
+    // every recorded parameter was accepted by conf, so it is accepted again.
+    for ( const auto& setting : kafka_settings ) {
+        if ( setting.first != skipped ) {
+            role_conf->set(setting.first, setting.second, error_string);
+        }
+    }
+
+    return role_conf;
+}
+
 bool PPM::configure() {
     logger->trace("starting configure()");
 
@@ -283,7 +341,7 @@ bool PPM::configure() {
                     done = true;
                 }
 
-                if ( conf->set(pieces[0], pieces[1], error_string) == RdKafka::Conf::CONF_OK ) {
+                if ( set_kafka(pieces[0], pieces[1], error_string) == RdKafka::Conf::CONF_OK ) {
                     logger->info("kafka configuration: " + pieces[0] + " = " + pieces[1]);
                     done = true;
                 }
@@ -323,12 +381,14 @@ bool PPM::configure() {
 
     logger->info("ppm mapfile: " + mapfile);
 
-    qptr = BuildGeofence( mapfile );                // throws.
+    // the workers share one read-only index.
+    geofence = BuildGeofence( mapfile );            // throws.
+    logger->info("ppm geofence " + std::string( geofence->name() ) + " index: " + std::to_string( geofence->cell_count() ) + " cells; " + std::to_string( geofence->entity_count() ) + " entities; " + std::to_string( geofence->footprint() ) + " bytes");
 
     if ( optIsSet('b') ) {
         // broker specified.
         logger->info("setting kafka broker to: " + optString('b'));
-        conf->set("metadata.broker.list", optString('b'), error_string);
+        set_kafka("metadata.broker.list", optString('b'), error_string);
     } 
 
     if ( optIsSet('p') ) {
@@ -354,22 +414,22 @@ bool PPM::configure() {
         std::string password = getEnvironmentVariable("CONFLUENT_SECRET");
 
         // set up config
-        conf->set("bootstrap.servers", getEnvironmentVariable("DOCKER_HOST_IP"), error_string);
-        conf->set("security.protocol", "SASL_SSL", error_string);
-        conf->set("sasl.mechanisms", "PLAIN", error_string);
-        conf->set("sasl.username", username.c_str(), error_string);
-        conf->set("sasl.password", password.c_str(), error_string);
-        conf->set("api.version.request", "true", error_string);
-        conf->set("api.version.fallback.ms", "0", error_string);
-        conf->set("broker.version.fallback", "0.10.0.0", error_string);
+        set_kafka("bootstrap.servers", getEnvironmentVariable("DOCKER_HOST_IP"), error_string);
+        set_kafka("security.protocol", "SASL_SSL", error_string);
+        set_kafka("sasl.mechanisms", "PLAIN", error_string);
+        set_kafka("sasl.username", username.c_str(), error_string);
+        set_kafka("sasl.password", password.c_str(), error_string);
+        set_kafka("api.version.request", "true", error_string);
+        set_kafka("api.version.fallback.ms", "0", error_string);
+        set_kafka("broker.version.fallback", "0.10.0.0", error_string);
 
         if (debug) {
-            conf->set("debug", "all", error_string);
+            set_kafka("debug", "all", error_string);
         }
     }
     // end of confluent cloud integration
 
-    if ( getOption('g').isSet() && conf->set("group.id", optString('g'), error_string) != RdKafka::Conf::CONF_OK) {
+    if ( getOption('g').isSet() && set_kafka("group.id", optString('g'), error_string) != RdKafka::Conf::CONF_OK) {
         // NOTE: there are some checks in librdkafka that require this to be present and set.
         logger->error("kafka error setting configuration parameters group.id h: " + error_string);
         return false;
@@ -395,7 +455,7 @@ bool PPM::configure() {
     // Do we want to exit if a stream eof is sent.
     exit_eof = getOption('x').isSet();
 
-    if (optIsSet('d') && conf->set("debug", optString('d'), error_string) != RdKafka::Conf::CONF_OK) {
+    if (optIsSet('d') && set_kafka("debug", optString('d'), error_string) != RdKafka::Conf::CONF_OK) {
         logger->error("kafka error setting configuration parameter debug: " + error_string);
         return false;
     }
@@ -442,70 +502,198 @@ bool PPM::configure() {
         }
     }
 
+    search = pconf.find("privacy.workers");
+    if ( search != pconf.end() ) {
+        try {
+            worker_count = std::max( 1, stoi( search->second ) );
+        } catch( std::exception& e ) {
+            logger->info("using the default number of workers.");
+        }
+    }
+
+    search = pconf.find("privacy.workers.queue.size");
+    if ( search != pconf.end() ) {
+        try {
+            worker_queue_size = std::max( 1, stoi( search->second ) );
+        } catch( std::exception& e ) {
+            logger->info("using the default worker queue size.");
+        }
+    }
+
+    logger->info("BSM processing workers: " + std::to_string(worker_count) + " with queue size: " + std::to_string(worker_queue_size));
+
+    search = pconf.find("privacy.consumer.batch.size");
+    if ( search != pconf.end() ) {
+        try {
+            batch_size = std::max( 1, stoi( search->second ) );
+        } catch( std::exception& e ) {
+            logger->info("using the default consumer batch size.");
+        }
+    }
+
+    search = pconf.find("privacy.consumer.batch.linger.ms");
+    if ( search != pconf.end() ) {
+        try {
+            batch_linger = std::max( 0, stoi( search->second ) );
+        } catch( std::exception& e ) {
+            logger->info("using the default consumer batch linger time.");
+        }
+    }
+
+    logger->info("consumer batch size: " + std::to_string(batch_size) + " with linger: " + std::to_string(batch_linger) + " ms");
+
+    search = pconf.find("privacy.producer.max.inflight");
+    if ( search != pconf.end() ) {
+        try {
+            max_inflight = std::max( 1L, stol( search->second ) );
+        } catch( std::exception& e ) {
+            logger->info("using the default maximum number of in-flight BSMs.");
+        }
+    }
+
+    logger->info("maximum in-flight BSMs: " + std::to_string(max_inflight));
+
+    // the producer and the consumer each get only their own role's parameters.
+    producer_conf = create_role_conf("enable.auto.commit");
+    consumer_conf = create_role_conf("transactional.id");
+
+    // with a transactional.id the output and the consumed offsets are committed in transactions (exactly-once).
+    std::string transactional_id;
+    if ( producer_conf->get("transactional.id", transactional_id) == RdKafka::Conf::CONF_OK && !transactional_id.empty() ) {
+        transactional = true;
+
+        // the offsets are committed with the transactions, never by the consumer.
+        if ( consumer_conf->set("enable.auto.commit", "false", error_string) != RdKafka::Conf::CONF_OK ) {
+            logger->error("kafka error disabling auto commit for transactions: " + error_string);
+            return false;
+        }
+
+        search = pconf.find("privacy.producer.transaction.size");
+        if ( search != pconf.end() ) {
+            try {
+                txn_size = std::max( 1, stoi( search->second ) );
+            } catch( std::exception& e ) {
+                logger->info("using the default transaction size.");
+            }
+        }
+
+        search = pconf.find("privacy.producer.transaction.interval.ms");
+        if ( search != pconf.end() ) {
+            try {
+                txn_interval = std::max( 0, stoi( search->second ) );
+            } catch( std::exception& e ) {
+                logger->info("using the default transaction interval.");
+            }
+        }
+
+        logger->info("transactional id: " + transactional_id + "; transactions commit every " + std::to_string(txn_size) + " BSMs or " + std::to_string(txn_interval) + " ms");
+    }
+
+    // when auto commit is off, the PPM commits the offsets of delivered or suppressed BSMs.
+    std::string auto_commit;
+    if ( consumer_conf->get("enable.auto.commit", auto_commit) == RdKafka::Conf::CONF_OK && auto_commit == "false" ) {
+        manual_commit = true;
+    }
+
+    search = pconf.find("privacy.consumer.commit.interval.ms");
+    if ( search != pconf.end() ) {
+        try {
+            commit_interval = std::max( 0, stoi( search->second ) );
+        } catch( std::exception& e ) {
+            logger->info("using the default offset commit interval.");
+        }
+    }
+
+    if ( manual_commit ) {
+        logger->info("offsets of delivered or suppressed BSMs are committed every " + std::to_string(commit_interval) + " ms");
+    }
+
+    search = pconf.find("privacy.stats.interval.ms");
+    if ( search != pconf.end() ) {
+        try {
+            stats_interval = std::max( 0, stoi( search->second ) );
+        } catch( std::exception& e ) {
+            logger->info("using the default pipeline stats interval.");
+        }
+    }
+
     logger->trace("ending configure()");
     return true;
 }
 
 bool PPM::msg_consume(RdKafka::Message* message, void* opaque, BSMHandler& handler) {
-    static std::string tsname;
-    static RdKafka::MessageTimestamp ts;
+    if (message->err() != RdKafka::ERR_NO_ERROR) {
+        consume_status(message);
+        return false;
+    }
 
-    // payload is a void *
-    // len is a size_t
-    std::string payload(static_cast<const char*>(message->payload()), message->len());
+    /* Real message */
+    bsm_recv_count++;
 
-    switch (message->err()) {
-        case RdKafka::ERR__TIMED_OUT:
-            logger->info("Waiting for more BSMs from the ODE producer.");
-            break;
+    bsm_recv_bytes += message->len();
 
-        case RdKafka::ERR_NO_ERROR:
-            /* Real message */
-            bsm_recv_count++;
+    logger->trace("Read message at byte offset: " + std::to_string(message->offset()) );
 
-            bsm_recv_bytes += message->len();
+    // called from multiple workers, so no statics here.
+    RdKafka::MessageTimestamp ts = message->timestamp();
 
-            logger->trace("Read message at byte offset: " + std::to_string(message->offset()) );
+    if (ts.type != RdKafka::MessageTimestamp::MSG_TIMESTAMP_NOT_AVAILABLE) {
+        std::string tsname;
 
-            ts = message->timestamp();
+        if (ts.type == RdKafka::MessageTimestamp::MSG_TIMESTAMP_CREATE_TIME) {
+            tsname = "create time";
+        } else if (ts.type == RdKafka::MessageTimestamp::MSG_TIMESTAMP_LOG_APPEND_TIME) {
+            tsname = "log append time";
+        } else {
+            tsname = "unknown";
+        }
 
-            if (ts.type != RdKafka::MessageTimestamp::MSG_TIMESTAMP_NOT_AVAILABLE) {
-                if (ts.type == RdKafka::MessageTimestamp::MSG_TIMESTAMP_CREATE_TIME) {
-                    tsname = "create time";
-                } else if (ts.type == RdKafka::MessageTimestamp::MSG_TIMESTAMP_LOG_APPEND_TIME) {
-                    tsname = "log append time";
-                } else {
-                    tsname = "unknown";
-                }
+        logger->trace("Message timestamp: " + tsname + ", type: " + std::to_string(ts.timestamp));
+    }
 
-                logger->trace("Message timestamp: " + tsname + ", type: " + std::to_string(ts.timestamp));
-            }
+    if ( message->key() ) {
+        logger->trace("Message key: " + *message->key() );
+    }
 
-            if ( message->key() ) {
-                logger->trace("Message key: " + *message->key() );
-            }
+    // Process the BSM payload straight out of the librdkafka buffer; payload is a void * and len is a size_t.
+    if ( handler.process( static_cast<const char*>(message->payload()), message->len() ) ) {
+        // the complete BSM was parsed, so we have all the information.
+        logger->info("BSM [RETAINED]: " + handler.get_bsm().logString());
+        return true;
+    } 
 
-            // Process the BSM payload.
-            if ( handler.process( payload ) ) {
-                // the complete BSM was parsed, so we have all the information.
-                logger->info("BSM [RETAINED]: " + handler.get_bsm().logString());
-                return true;
-                
-            } else {
-                // Suppressed BSM.
-                logger->info("BSM [SUPPRESSED-" + handler.get_result_string() + "]: " + handler.get_bsm().logString());
-                bsm_filt_count++;
-                bsm_filt_bytes += message->len();
-            } // return false;
+    // Suppressed BSM.
+    logger->info("BSM [SUPPRESSED-" + handler.get_result_string() + "]: " + handler.get_bsm().logString());
+    bsm_filt_count++;
+    bsm_filt_bytes += message->len();
+    return false;
+}
+
+void PPM::consume_status(RdKafka::Message* message) {
+    switch (message->err()) {
+        case RdKafka::ERR__TIMED_OUT:
+            logger->info("Waiting for more BSMs from the ODE producer.");
+            break;
 
+        case RdKafka::ERR_NO_ERROR:
+            // BSMs are handled by msg_consume.
             break;
 
         case RdKafka::ERR__PARTITION_EOF:
-            logger->info("ODE BSM consumer partition end of file, but PPM still alive.");
+            logger->info("ODE BSM consumer partition " + std::to_string(message->partition()) + " end of file, but PPM still alive.");
             if (exit_eof) {
-                eof_cnt++;
+                auto search = assigned_partitions.find( message->partition() );
+                if ( search != assigned_partitions.end() ) {
+                    search->second.eof = true;
+                }
 
-                if (eof_cnt == partition_cnt) {
+                // every assigned partition must be at its end.
+                int eof_cnt = 0;
+                for ( const auto& assigned : assigned_partitions ) {
+                    if ( assigned.second.eof ) ++eof_cnt;
+                }
+
+                if (eof_cnt > 0 && eof_cnt == partition_cnt) {
                     logger->info("EOF reached for all " + std::to_string(partition_cnt) + " partition(s)");
                     bsms_available = false;
                 }
@@ -526,11 +714,316 @@ bool PPM::msg_consume(RdKafka::Message* message, void* opaque, BSMHandler& handl
             logger->error("cannot consume due to an error: " + message->errstr());
             bsms_available = false;
     }
+}
 
-    return false;
+void PPM::process_batch(MessageBatch& batch, BSMHandler& handler, OutputBatch& retained) {
+    for ( auto& message : batch ) {
+        if ( msg_consume(message.get(), NULL, handler) ) {
+            // move the JSON into a pooled buffer; it comes back to the pool in the delivery report.
+            BufferPool::Buffer* buffer = output_buffers.acquire();
+            handler.swap_json( buffer->json );
+            buffer->partition = message->partition();
+            buffer->offset = message->offset();
+            retained.push_back( RetainedBSM{ buffer, std::string{} } );
+
+            if ( forward_keys && message->key_pointer() ) {
+                retained.back().key.assign( static_cast<const char*>( message->key_pointer() ), message->key_len() );
+            }
+
+            continue;
+        }
+
+        // deliberately suppressed (or not a BSM); nothing will be delivered for it.
+        bsm_pending_count--;
+
+        if ( manual_commit ) {
+            offsets.completed( message->partition(), message->offset() );
+        }
+    }
+}
+
+void PPM::publish(OutputBatch& retained) {
+    for ( auto& bsm : retained ) {
+        if ( transactional && ( txn_aborted || !begin_transaction() ) ) {
+            // the consumer rewinds to the committed offsets, so this BSM is processed again.
+            output_buffers.release( bsm.buffer );
+            bsm_pending_count--;
+            continue;
+        }
+
+        // bound the BSMs waiting on the broker; delivery reports are served while waiting.
+        while ( bsm_inflight_count >= max_inflight ) {
+            producer->poll( 10 );
+        }
+
+        // hand the JSON to librdkafka without a copy.
+        const std::string* key = bsm.key.empty() ? NULL : &bsm.key;
+        RdKafka::ErrorCode status = producer->produce(filtered_topic.get(), partition, 0, const_cast<char *>(bsm.buffer->json.data()), bsm.buffer->json.size(), key, bsm.buffer);
+
+        while (status == RdKafka::ERR__QUEUE_FULL) {
+            // wait for librdkafka to deliver (or expire) queued BSMs instead of dropping this one.
+            producer->poll( 100 );
+            status = producer->produce(filtered_topic.get(), partition, 0, const_cast<char *>(bsm.buffer->json.data()), bsm.buffer->json.size(), key, bsm.buffer);
+        }
+
+        if (status != RdKafka::ERR_NO_ERROR) {
+            logger->error("failed to produce retained BSM because: " + RdKafka::err2str( status ));
+
+            if ( transactional ) {
+                // the open transaction cannot cover this BSM; abort it so the consumer rewinds and replays the BSM.
+                std::string reason = "the BSM was not produced: " + RdKafka::err2str( status );
+                transaction_failed( RdKafka::Error::create( status, &reason ), "produce into" );
+
+            } else if ( manual_commit ) {
+                // as for a failed delivery, the consumer goes back to the committed offsets.
+                offsets.failed( bsm.buffer->partition, bsm.buffer->offset );
+            }
+
+            // librdkafka did not take the buffer.
+            output_buffers.release( bsm.buffer );
+            bsm_fail_count++;
+            bsm_pending_count--;
+
+        } else {
+            // counted as published when the delivery report arrives.
+            bsm_inflight_count++;
+            logger->trace("produced BSM successfully.");
+
+            if ( transactional ) {
+                // the transaction commits this BSM and its consumed offset together.
+                offsets.completed( bsm.buffer->partition, bsm.buffer->offset );
+                txn_count++;
+            }
+        }
+    }
+
+    // serve delivery reports once per batch instead of once per message.
+    poll_producer();
+}
+
+void PPM::poll_producer() {
+    producer->poll(0);
+
+    if ( transactional ) {
+        // a commit requested by the consumer thread (for a rebalance) does not wait for the size or interval.
+        bool requested = txn_commit_requested.exchange( false );
+        commit_transaction( requested );
+        if ( requested ) txn_commits++;
+    }
+}
+
+void PPM::complete_transaction() {
+    if ( transactional ) {
+        commit_transaction( true );
+    }
+}
+
+bool PPM::begin_transaction() {
+    if ( txn_open ) return true;
+
+    RdKafka::Error* error = producer->begin_transaction();
+    if ( error ) {
+        transaction_failed( error, "begin" );
+        return false;
+    }
+
+    txn_open = true;
+    txn_count = 0;
+    return true;
 }
 
-Quad::Ptr PPM::BuildGeofence( const std::string& mapfile )  // throws
+void PPM::commit_transaction(bool force) {
+    if ( txn_aborted ) return;
+
+    auto now = std::chrono::steady_clock::now();
+    if ( !force && txn_count < txn_size && now - txn_last < std::chrono::milliseconds( txn_interval ) ) return;
+
+    txn_last = now;
+
+    OffsetTracker::CommitList commits = offsets.take_commits();
+    if ( !txn_open && commits.empty() ) return;
+
+    if ( !begin_transaction() ) return;
+
+    if ( !commits.empty() ) {
+        std::vector<RdKafka::TopicPartition*> positions;
+        for ( auto& commit : commits ) {
+            RdKafka::TopicPartition* position = RdKafka::TopicPartition::create( consumed_topic, commit.first );
+            position->set_offset( commit.second );
+            positions.push_back( position );
+        }
+
+        RdKafka::ConsumerGroupMetadata* group = consumer->groupMetadata();
+        RdKafka::Error* error = producer->send_offsets_to_transaction( positions, group, txn_timeout );
+        delete group;
+
+        for ( auto* position : positions ) {
+            delete position;
+        }
+
+        if ( error ) {
+            transaction_failed( error, "send the offsets of" );
+            return;
+        }
+    }
+
+    RdKafka::Error* error = producer->commit_transaction( txn_timeout );
+    if ( error ) {
+        transaction_failed( error, "commit" );
+        return;
+    }
+
+    logger->trace("committed transaction with " + std::to_string(txn_count) + " BSMs.");
+    txn_open = false;
+    txn_count = 0;
+}
+
+void PPM::transaction_failed(RdKafka::Error* error, const std::string& action) {
+    logger->error("failed to " + action + " the producer transaction because: " + error->str());
+
+    if ( error->is_fatal() ) {
+        // the producer cannot be used anymore.
+        logger->critical("fatal producer transaction error; the PPM must stop.");
+        bootstrap = false;
+        bsms_available = false;
+
+    } else if ( txn_open ) {
+        RdKafka::Error* abort_error = producer->abort_transaction( txn_timeout );
+        if ( abort_error ) {
+            logger->error("failed to abort the producer transaction because: " + abort_error->str());
+            delete abort_error;
+        }
+    }
+
+    delete error;
+    txn_open = false;
+    txn_count = 0;
+
+    // the aborted BSMs are discarded by the brokers; the consumer must go back to the committed offsets.
+    txn_aborted = true;
+}
+
+void PPM::commit_offsets(bool synchronous) {
+    OffsetTracker::CommitList commits = offsets.take_commits();
+    if ( commits.empty() ) return;
+
+    std::vector<RdKafka::TopicPartition*> positions;
+    for ( auto& commit : commits ) {
+        RdKafka::TopicPartition* position = RdKafka::TopicPartition::create( consumed_topic, commit.first );
+        position->set_offset( commit.second );
+        positions.push_back( position );
+    }
+
+    RdKafka::ErrorCode err = synchronous ? consumer->commitSync( positions ) : consumer->commitAsync( positions );
+    if ( err != RdKafka::ERR_NO_ERROR ) {
+        logger->error("failed to commit consumer offsets because: " + RdKafka::err2str( err ));
+    }
+
+    for ( auto* position : positions ) {
+        delete position;
+    }
+}
+
+void PPM::dispatch_batches() {
+    for ( std::size_t i = 0; i < workers.size(); ++i ) {
+        if ( !batches[i].empty() ) {
+            workers[i]->dispatch( std::move( batches[i] ) );
+            batches[i].clear();
+        }
+    }
+}
+
+void PPM::drain_pipeline() {
+    // without a pipeline nothing is pending.
+    if ( workers.empty() ) return;
+
+    dispatch_batches();
+
+    unsigned attempts = 0;
+    while ( bsm_pending_count > 0 && !txn_aborted && bootstrap ) {
+        ring_backoff( attempts );
+    }
+
+    if ( transactional ) {
+        // only the publisher thread uses the transaction; ask it to commit and wait.
+        unsigned commits = txn_commits;
+        txn_commit_requested = true;
+
+        attempts = 0;
+        while ( txn_commits == commits && !txn_aborted && bootstrap ) {
+            ring_backoff( attempts );
+        }
+
+    } else if ( manual_commit ) {
+        commit_offsets( true );
+    }
+}
+
+void PPM::rebalance(RdKafka::KafkaConsumer* kafka_consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& changed) {
+    bool cooperative = kafka_consumer->rebalance_protocol() == "COOPERATIVE";
+    RdKafka::Error* error = NULL;
+    RdKafka::ErrorCode assign_err = RdKafka::ERR_NO_ERROR;
+
+    if ( err == RdKafka::ERR__ASSIGN_PARTITIONS ) {
+        for ( auto* partition : changed ) {
+            assigned_partitions[ partition->partition() ] = PartitionState{ false, 0 };
+            logger->info("Consumer assigned partition " + std::to_string( partition->partition() ) + " of topic: " + partition->topic() + ".");
+        }
+
+        if ( cooperative ) {
+            error = kafka_consumer->incremental_assign( changed );
+        } else {
+            assign_err = kafka_consumer->assign( changed );
+        }
+
+    } else if ( err == RdKafka::ERR__REVOKE_PARTITIONS ) {
+        // finish and commit the revoked partitions' BSMs so their next owner does not publish them again.
+        drain_pipeline();
+
+        for ( auto* partition : changed ) {
+            auto search = assigned_partitions.find( partition->partition() );
+            if ( search != assigned_partitions.end() ) {
+                logger->info("Consumer revoked partition " + std::to_string( partition->partition() ) + " after " + std::to_string( search->second.consumed ) + " BSMs.");
+                assigned_partitions.erase( search );
+            }
+
+            offsets.erase( partition->partition() );
+        }
+
+        if ( cooperative ) {
+            error = kafka_consumer->incremental_unassign( changed );
+        } else {
+            assign_err = kafka_consumer->unassign();
+        }
+
+    } else {
+        logger->error("Consumer rebalance failed because: " + RdKafka::err2str( err ));
+        assigned_partitions.clear();
+        assign_err = kafka_consumer->unassign();
+    }
+
+    if ( error ) {
+        logger->error("Consumer failed to change its partition assignment because: " + error->str());
+        delete error;
+    }
+
+    if ( assign_err != RdKafka::ERR_NO_ERROR ) {
+        logger->error("Consumer failed to change its partition assignment because: " + RdKafka::err2str( assign_err ));
+    }
+
+    partition_cnt = static_cast<int>( assigned_partitions.size() );
+}
+
+void PPM::log_pipeline_stats() {
+    std::string depths;
+    for ( std::size_t i = 0; i < workers.size(); ++i ) {
+        depths += " worker " + std::to_string(i) + " in/out: " + std::to_string( workers[i]->input_depth() ) + "/" + std::to_string( workers[i]->output_depth() ) + ";";
+    }
+
+    logger->info("PPM pipeline ring depths (batches):" + depths + " assigned partitions: " + std::to_string( partition_cnt ) + "; in-flight BSMs: " + std::to_string( bsm_inflight_count ) + "; uncommitted offsets: " + std::to_string( offsets.pending() ) + "; output buffers in use: " + std::to_string( output_buffers.outstanding() ) + "; producer queue: " + std::to_string( producer->outq_len() ));
+}
+
+SpatialIndex::CPtr PPM::BuildGeofence( const std::string& mapfile )  // throws
 {
     geo::Point sw, ne;
 
@@ -556,28 +1049,91 @@ Quad::Ptr PPM::BuildGeofence( const std::string& mapfile )  // throws
         ne.lon = stod(search->second);
     }
 
-    Quad::Ptr qptr = std::make_shared<Quad>(sw, ne);
-
     // Read the file and parse the shapes.
     shapes::CSVInputFactory shape_factory( mapfile );
     shape_factory.make_shapes();
 
-    // Add all the shapes to the quad.
+    // Collect all the shapes for the index.
     // NOTE: we are only using Edges right now.
+    geo::Entity::PtrList entities;
     for (auto& circle_ptr : shape_factory.get_circles()) {
-        Quad::insert(qptr, std::dynamic_pointer_cast<const geo::Entity>(circle_ptr)); 
+        entities.push_back(std::dynamic_pointer_cast<const geo::Entity>(circle_ptr)); 
+    }
+
+    // Each edge is stored with its extended area, so the area is not rebuilt for every BSM checked against the edge.
+    double extension = BSMHandler::kDefaultBoxExtension;
+    search = pconf.find("privacy.filter.geofence.extension");
+    if ( search != pconf.end() ) {
+        extension = stod(search->second);
     }
 
     for (auto& edge_ptr : shape_factory.get_edges()) {
-        Quad::insert(qptr, std::dynamic_pointer_cast<const geo::Entity>(edge_ptr)); 
+        try {
+            entities.push_back(std::make_shared<const geo::Corridor>(edge_ptr, extension)); 
+        } catch (const geo::ZeroAreaException&) {
+            // no area to precompute; the edge is stored as it is.
+            entities.push_back(std::dynamic_pointer_cast<const geo::Entity>(edge_ptr)); 
+        }
     }
 
     for (auto& grid_ptr : shape_factory.get_grids()) {
-        Quad::insert(qptr, std::dynamic_pointer_cast<const geo::Entity>(grid_ptr)); 
+        entities.push_back(std::dynamic_pointer_cast<const geo::Entity>(grid_ptr)); 
+    }
+
+    std::string index = "quad";
+    search = pconf.find("privacy.filter.geofence.index");
+    if ( search != pconf.end() ) {
+        index = search->second;
+    }
+
+    if ( index == "grid" ) {
+        double cell_degrees = GridIndex::kDefaultCellDegrees;
+        search = pconf.find("privacy.filter.geofence.cell.size");
+        if ( search != pconf.end() ) {
+            cell_degrees = stod(search->second);
+        }
+
+        logger->trace("Completed BuildGeofence.");
+        return std::make_shared<const GridIndex>(sw, ne, cell_degrees, entities);      // throws.
+    }
+
+    if ( index != "quad" ) {
+        logger->warn("unknown geofence index: " + index + "; using quad.");
+    }
+
+    Quad::Ptr qptr = std::make_shared<Quad>(sw, ne);
+    for (auto& entity_ptr : entities) {
+        Quad::insert(qptr, entity_ptr); 
     }
 
     logger->trace("Completed BuildGeofence.");
-    return qptr;
+    return std::make_shared<const FrozenQuad>(*qptr);
+}
+
+void PPM::delivered(RdKafka::Message& message) {
+    BufferPool::Buffer* buffer = static_cast<BufferPool::Buffer*>( message.msg_opaque() );
+    bsm_inflight_count--;
+
+    if (message.err() != RdKafka::ERR_NO_ERROR) {
+        // the consumed offset is never completed; the consumer goes back to the committed offsets to process it again.
+        bsm_fail_count++;
+        logger->error("failed to deliver retained BSM because: " + message.errstr());
+
+        if ( manual_commit && !transactional ) {
+            offsets.failed( buffer->partition, buffer->offset );
+        }
+    } else {
+        bsm_send_count++;
+        bsm_send_bytes += message.len();
+
+        // in transactional mode the offset was completed when the BSM joined the transaction.
+        if ( manual_commit && !transactional ) {
+            offsets.completed( buffer->partition, buffer->offset );
+        }
+    }
+
+    output_buffers.release( buffer );
+    bsm_pending_count--;
 }
 
 bool PPM::launch_producer()
@@ -585,12 +1141,27 @@ bool PPM::launch_producer()
     std::string error_string;
 
     if (!producer) {
-        producer = std::shared_ptr<RdKafka::Producer>( RdKafka::Producer::create(conf, error_string) );
+        if (producer_conf->set("dr_cb", &delivery_report, error_string) != RdKafka::Conf::CONF_OK) {
+            logger->critical("Failed to set the producer delivery report callback with error: " + error_string + ".");
+            return false;
+        }
+
+        producer = std::shared_ptr<RdKafka::Producer>( RdKafka::Producer::create(producer_conf, error_string) );
 
         if (!producer) {
             logger->critical("Failed to create producer with error: " + error_string + ".");
             return false;
         }
+
+        if ( transactional ) {
+            RdKafka::Error* error = producer->init_transactions( txn_timeout );
+            if ( error ) {
+                logger->critical("Failed to initialize producer transactions with error: " + error->str() + ".");
+                delete error;
+                producer.reset();
+                return false;
+            }
+        }
     }
 
     filtered_topic = std::shared_ptr<RdKafka::Topic>( RdKafka::Topic::create(producer.get(), published_topic, tconf, error_string) );
@@ -608,7 +1179,12 @@ bool PPM::launch_consumer()
     std::string error_string;
     
     if (!consumer) {
-        consumer = std::shared_ptr<RdKafka::KafkaConsumer>( RdKafka::KafkaConsumer::create(conf, error_string) );
+        if (consumer_conf->set("rebalance_cb", &rebalance_handler, error_string) != RdKafka::Conf::CONF_OK) {
+            logger->critical("Failed to set the consumer rebalance callback with error: " + error_string + ".");
+            return false;
+        }
+
+        consumer = std::shared_ptr<RdKafka::KafkaConsumer>( RdKafka::KafkaConsumer::create(consumer_conf, error_string) );
 
         if (!consumer) {
             logger->critical("Failed to create consumer with error: " + error_string );
@@ -732,7 +1308,6 @@ bool PPM::make_loggers( bool remove_files )
 int PPM::operator()(void) {
 
     std::string error_string;
-    RdKafka::ErrorCode status;
 
     signal(SIGINT, sigterm);
     signal(SIGTERM, sigterm);
@@ -765,7 +1340,21 @@ int PPM::operator()(void) {
         }
 
         // JMC: There was leak in here caused by RapidJSON.  It has been fixed.  The notes are in that class's code.
-        BSMHandler handler{qptr, pconf, logger};
+        // Pipeline: this thread consumes, the workers process, and the publisher produces. Each worker has its own
+        // BSMHandler; the quad tree is shared.
+        for ( int i = 0; i < worker_count; ++i ) {
+            workers.emplace_back( new PPMWorker{ *this, geofence, pconf, logger, worker_queue_size } );
+        }
+
+        publisher.reset( new PPMPublisher{ *this, workers } );
+        WorkerDispatcher dispatcher{ pconf, workers.size() };
+
+        // keyed output keeps a vehicle's BSMs in one output partition; the vehicle id is never used as a key since it
+        // may be redacted.
+        forward_keys = dispatcher.get_mode() == WorkerDispatcher::KEY;
+        logger->info(std::string("BSMs are dispatched to workers by ") + (forward_keys ? "vehicle id or message key." : "partition."));
+        auto next_stats = std::chrono::steady_clock::now() + std::chrono::milliseconds( stats_interval );
+        auto next_commit = std::chrono::steady_clock::now() + std::chrono::milliseconds( commit_interval );
 
         std::vector<RdKafka::TopicPartition*> partitions;
         RdKafka::ErrorCode err = consumer->position(partitions);
@@ -778,36 +1367,246 @@ int PPM::operator()(void) {
             }
         }
 
-        // consume-produce loop.
-        while (bsms_available) {
-            std::unique_ptr<RdKafka::Message> msg{ consumer->consume( consumer_timeout ) };
-
-            if ( msg_consume(msg.get(), NULL, handler) ) {
-                status = producer->produce(filtered_topic.get(), partition, RdKafka::Producer::RK_MSG_COPY, (void *)handler.get_json().c_str(), handler.get_bsm_buffer_size(), NULL, NULL);
-
-                if (status != RdKafka::ERR_NO_ERROR) {
-                    logger->error("failed to produce retained BSM because: " + RdKafka::err2str( status ));
+        // consume-dispatch loop.
+        batches.resize( workers.size() );
+
+        BatchFiller filler{ batch_size, batch_linger, consumer_timeout };
+
+        while (bsms_available && !txn_aborted && !offsets.rewind_needed()) {
+            // fill a batch until it has batch_size messages or batch_linger ms have passed since its first message.
+            filler.fill(
+                [this]( int timeout ) { return std::unique_ptr<RdKafka::Message>{ consumer->consume( timeout ) }; },
+                [this, &dispatcher]( std::unique_ptr<RdKafka::Message> msg ) {
+                    auto assigned = assigned_partitions.find( msg->partition() );
+                    if ( assigned != assigned_partitions.end() ) {
+                        // a partition that was at its end has new BSMs.
+                        assigned->second.eof = false;
+                        assigned->second.consumed++;
+                    }
+
+                    // a partition (or key) is always handled by the same worker to preserve its order.
+                    bsm_pending_count++;
+                    if ( manual_commit ) {
+                        offsets.consumed( msg->partition(), msg->offset() );
+                    }
+
+                    std::size_t worker = dispatcher.route( msg->partition(), msg->key_pointer(), msg->key_len(), static_cast<const char*>( msg->payload() ), msg->len() );
+                    batches[ worker ].push_back( std::move( msg ) );
+                },
+                [this]( RdKafka::Message* msg ) { consume_status( msg ); },
+                bsms_available );
+
+            dispatch_batches();
+
+            if ( manual_commit && !transactional && std::chrono::steady_clock::now() >= next_commit ) {
+                commit_offsets( false );
+                next_commit = std::chrono::steady_clock::now() + std::chrono::milliseconds( commit_interval );
+            }
 
-                } else {
-                    // successfully sent; update counters.
-                    bsm_send_count++;
-                    bsm_send_bytes += msg->len();
-                    logger->trace("produced BSM successfully.");
-                }
+            if ( stats_interval > 0 && std::chrono::steady_clock::now() >= next_stats ) {
+                log_pipeline_stats();
+                next_stats = std::chrono::steady_clock::now() + std::chrono::milliseconds( stats_interval );
             }
 
-            // NOTE: good for troubleshooting, but bad for performance.
+            // NOTE: good for troubleshooting, but bad for performance; done once per batch.
             logger->flush();
         }
+
+        // finish the BSMs that have already been dispatched; upstream stages stop first.
+        for ( auto& worker : workers ) {
+            worker->stop();
+        }
+
+        publisher->stop();
+        log_pipeline_stats();
+
+        // wait for the delivery reports so the output buffers return to the pool.
+        if ( producer->flush( 5000 ) != RdKafka::ERR_NO_ERROR ) {
+            logger->warn("PPM producer still has " + std::to_string( bsm_inflight_count ) + " undelivered BSMs.");
+        }
+
+        if ( manual_commit && !transactional ) {
+            commit_offsets( true );
+        }
+
+        if ( txn_aborted || offsets.rewind_needed() ) {
+            // a new consumer resumes from the offsets committed by the last successful transaction, or just before the
+            // first BSM that was not delivered.
+            logger->warn(std::string(txn_aborted ? "producer transaction aborted" : "retained BSM not delivered") + "; restarting the consumer from the committed offsets.");
+            consumer->close();
+            consumer.reset();
+            offsets.clear();
+            assigned_partitions.clear();
+            partition_cnt = 0;
+            txn_aborted = false;
+        }
+
+        // a rebalance after this point has nothing left to drain.
+        publisher.reset();
+        workers.clear();
+        batches.clear();
     }
 
     logger->info("PPM operations complete; shutting down...");
     logger->info("PPM consumed  : " + std::to_string(bsm_recv_count) + " BSMs and " + std::to_string(bsm_recv_bytes) + " bytes");
     logger->info("PPM published : " + std::to_string(bsm_send_count) + " BSMs and " + std::to_string(bsm_send_bytes) + " bytes");
     logger->info("PPM suppressed: " + std::to_string(bsm_filt_count) + " BSMs and " + std::to_string(bsm_filt_bytes) + " bytes");
+    logger->info("PPM failed    : " + std::to_string(bsm_fail_count) + " BSMs");
     return EXIT_SUCCESS;
 }
 
+PPMDeliveryReport::PPMDeliveryReport( PPM& ppm ) :
+    ppm_( ppm )
+{}
+
+void PPMDeliveryReport::dr_cb( RdKafka::Message& message )
+{
+    ppm_.delivered( message );
+}
+
+PPMRebalance::PPMRebalance( PPM& ppm ) :
+    ppm_( ppm )
+{}
+
+void PPMRebalance::rebalance_cb( RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err, std::vector<RdKafka::TopicPartition*>& partitions )
+{
+    ppm_.rebalance( consumer, err, partitions );
+}
+
+PPMWorker::PPMWorker( PPM& ppm, SpatialIndex::CPtr index_ptr, const ConfigMap& conf, std::shared_ptr<PpmLogger> logger, std::size_t capacity ) :
+    ppm_( ppm ),
+    handler_{ index_ptr, conf, logger },
+    input_{ capacity },
+    output_{ capacity },
+    stopping_{ false },
+    thread_{}
+{
+    // start the thread after all the members it uses are constructed.
+    thread_ = std::thread{ &PPMWorker::run, this };
+}
+
+PPMWorker::~PPMWorker()
+{
+    stop();
+}
+
+void PPMWorker::dispatch( MessageBatch&& batch )
+{
+    unsigned attempts = 0;
+
+    // a full ring holds up the consumer; that is the backpressure.
+    while ( !input_.try_push( std::move( batch ) ) ) {
+        ring_backoff( attempts );
+    }
+}
+
+bool PPMWorker::collect( OutputBatch& batch )
+{
+    return output_.try_pop( batch );
+}
+
+void PPMWorker::stop()
+{
+    stopping_ = true;
+    if ( thread_.joinable() ) thread_.join();
+}
+
+std::size_t PPMWorker::input_depth() const
+{
+    return input_.size();
+}
+
+std::size_t PPMWorker::output_depth() const
+{
+    return output_.size();
+}
+
+void PPMWorker::run()
+{
+    MessageBatch batch;
+    OutputBatch retained;
+    unsigned idle = 0;
+
+    for (;;) {
+        // read the flag first so a batch dispatched before stop() is never missed.
+        bool stopping = stopping_;
+
+        if ( !input_.try_pop( batch ) ) {
+            if ( stopping ) break;
+            ring_backoff( idle );
+            continue;
+        }
+
+        idle = 0;
+        ppm_.process_batch( batch, handler_, retained );
+        batch.clear();
+
+        if ( !retained.empty() ) {
+            unsigned attempts = 0;
+
+            // a full ring means the producer is behind; wait for it.
+            while ( !output_.try_push( std::move( retained ) ) ) {
+                ring_backoff( attempts );
+            }
+
+            retained.clear();
+        }
+    }
+}
+
+PPMPublisher::PPMPublisher( PPM& ppm, const std::vector<PPMWorker::Ptr>& workers ) :
+    ppm_( ppm ),
+    workers_( workers ),
+    stopping_{ false },
+    thread_{}
+{
+    thread_ = std::thread{ &PPMPublisher::run, this };
+}
+
+PPMPublisher::~PPMPublisher()
+{
+    stop();
+}
+
+void PPMPublisher::stop()
+{
+    stopping_ = true;
+    if ( thread_.joinable() ) thread_.join();
+}
+
+void PPMPublisher::run()
+{
+    OutputBatch retained;
+    unsigned idle = 0;
+
+    for (;;) {
+        // read the flag first so the final pass sees everything the stopped workers left behind.
+        bool stopping = stopping_;
+        bool collected = false;
+
+        for ( auto& worker : workers_ ) {
+            while ( worker->collect( retained ) ) {
+                ppm_.publish( retained );
+                retained.clear();
+                collected = true;
+            }
+        }
+
+        if ( collected ) {
+            idle = 0;
+            continue;
+        }
+
+        if ( stopping ) {
+            ppm_.complete_transaction();
+            break;
+        }
+
+        ppm_.poll_producer();
+        ring_backoff( idle );
+    }
+}
+
 const char* PPM::getEnvironmentVariable(const char* variableName) {
     const char* toReturn = getenv(variableName);
     if (!toReturn) {
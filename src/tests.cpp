@@ -19,13 +19,26 @@
 #include <string>
 #include <vector>
 // #include <iterator>
-// #include <algorithm>
+#include <algorithm>
 #include <regex>
 #include <iomanip>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <clocale>
 
 #include "cvlib.hpp"
 #include "bsmHandler.hpp"
 #include "bsm.hpp"
+#include "spscRing.hpp"
+#include "bufferPool.hpp"
+#include "workerDispatcher.hpp"
+#include "offsetTracker.hpp"
+#include "batchFiller.hpp"
+#include "jsonArena.hpp"
 
 static std::shared_ptr<PpmLogger> testLogger = std::make_shared<PpmLogger>("test.log");
 
@@ -76,7 +89,11 @@ bool buildBaseConfiguration( ConfigMap& conf ) {
     return true;
 }
 
-Quad::Ptr buildTestQuadTree( void ) {
+/**
+ * @brief Build a small road network on the UT campus, as PPM::BuildGeofence stores it: each edge with its extended area
+ * when corridor_extension is positive.
+ */
+geo::Entity::PtrList buildTestEntities( double corridor_extension = 0.0 ) {
     geo::Location sw1(35.951853, -83.932832);
     geo::Location ne1(35.953642, -83.929975);
 
@@ -99,21 +116,96 @@ Quad::Ptr buildTestQuadTree( void ) {
     geo::Circle::Ptr c1 = std::make_shared<geo::Circle>(35.951250, -83.931861, 10.0);
     geo::Grid::Ptr g1 = std::make_shared<geo::Grid>(sw1, ne1, 0, 0);
 
-    // Setup the quad.
-    geo::Point sw{ 35.946920, -83.938486 };
-    geo::Point ne{ 35.955526, -83.926738 };
+    geo::Entity::PtrList entities;
+    for ( auto& edge_ptr : { r1, r2, r3, r4, r5, r6 } ) {
+        if ( corridor_extension > 0.0 ) {
+            entities.push_back( std::make_shared<const geo::Corridor>( edge_ptr, corridor_extension ) );
+        } else {
+            entities.push_back( edge_ptr );
+        }
+    }
+
+    entities.push_back( c1 );
+    entities.push_back( g1 );
+
+    return entities;
+}
+
+const geo::Point kTestSW{ 35.946920, -83.938486 };          ///< The corners of the test region.
+const geo::Point kTestNE{ 35.955526, -83.926738 };
 
+Quad::Ptr buildTestQuadTree( double corridor_extension = 0.0 ) {
     // Declare a quad with the given bounds.
-    Quad::Ptr qptr = std::make_shared<Quad>(sw, ne);
+    Quad::Ptr qptr = std::make_shared<Quad>( kTestSW, kTestNE );
+
+    for ( auto& entity_ptr : buildTestEntities( corridor_extension ) ) {
+        Quad::insert( qptr, entity_ptr );
+    }
+
+    return qptr;
+}
+
+/**
+ * @brief Load a map from the data directory as PPM::BuildGeofence does, with corridors of the given extension.
+ *
+ * @param mapname the map file in the data directory.
+ * @param sw set to the southwest corner of the map's vertices, less a small margin.
+ * @param ne set to the northeast corner of the map's vertices, plus a small margin.
+ * @param vertices filled with the first vertex of every edge; used to place test points on the road.
+ * @return the entities; empty if the map file is not found.
+ */
+geo::Entity::PtrList loadMapEntities( const std::string& mapname, double corridor_extension, geo::Point& sw, geo::Point& ne, std::vector<geo::Point>& vertices ) {
+    const std::string mapfile = std::string{ CVDP_DATA_DIR } + "/" + mapname;
+    std::ifstream probe{ mapfile };
+    if ( !probe ) {
+        return geo::Entity::PtrList{};
+    }
+
+    shapes::CSVInputFactory shape_factory{ mapfile };
+    shape_factory.make_shapes();
+
+    sw = geo::Point{ 90.0, 180.0 };
+    ne = geo::Point{ -90.0, -180.0 };
+    for ( auto& edge_ptr : shape_factory.get_edges() ) {
+        for ( auto& pt : { edge_ptr->v1, edge_ptr->v2 } ) {
+            sw.lat = std::min( sw.lat, pt->lat );
+            sw.lon = std::min( sw.lon, pt->lon );
+            ne.lat = std::max( ne.lat, pt->lat );
+            ne.lon = std::max( ne.lon, pt->lon );
+        }
+    }
+    sw.lat -= 0.01; sw.lon -= 0.01;
+    ne.lat += 0.01; ne.lon += 0.01;
+
+    geo::Entity::PtrList entities;
+    for ( auto& edge_ptr : shape_factory.get_edges() ) {
+        vertices.push_back( *edge_ptr->v1 );
+        try {
+            entities.push_back( std::make_shared<const geo::Corridor>( edge_ptr, corridor_extension ) );
+        } catch ( const geo::ZeroAreaException& ) {
+            entities.push_back( std::dynamic_pointer_cast<const geo::Entity>( edge_ptr ) );
+        }
+    }
+
+    return entities;
+}
+
+/**
+ * @brief Build the geofence quad tree for data/I_80.edges.
+ *
+ * @return the quad tree; empty if the map file is not found.
+ */
+Quad::Ptr buildI80QuadTree( double corridor_extension, std::vector<geo::Point>& vertices ) {
+    geo::Point sw, ne;
+    geo::Entity::PtrList entities = loadMapEntities( "I_80.edges", corridor_extension, sw, ne, vertices );
+    if ( entities.empty() ) {
+        return Quad::Ptr{};
+    }
 
-    Quad::insert( qptr, r1);
-    Quad::insert( qptr, r2);
-    Quad::insert( qptr, r3);
-    Quad::insert( qptr, r4);
-    Quad::insert( qptr, r5);
-    Quad::insert( qptr, r6);
-    Quad::insert( qptr, c1);
-    Quad::insert( qptr, g1);
+    Quad::Ptr qptr = std::make_shared<Quad>( sw, ne );
+    for ( auto& entity_ptr : entities ) {
+        Quad::insert( qptr, entity_ptr );
+    }
 
     return qptr;
 }
@@ -422,6 +514,121 @@ TEST_CASE( "Parse Shape File Data", "[quad][shapefile]" ) {
     CHECK_NOTHROW(output_factory.write_shapes());
 }
 
+TEST_CASE( "Decimal Conversion", "[utilities][decimal]" ) {
+
+    SECTION( "Same As strtod" ) {
+        // coordinates and speeds at every precision the ODE writes, and a few at the edges of the direct conversion.
+        std::mt19937_64 generator{ 20170802 };
+        std::uniform_real_distribution<double> distribution{ -180.0, 180.0 };
+        std::vector<std::string> numbers{ "0", "-0", "0.0", "-0.0", "22.1", "22.00", "35.94911", "-83.928343", "7.55e-5",
+                                          "1E3", "0.1", "0.30000000000000004", "123456789012345", "1234567890.12345",
+                                          "0.000000000000000000001", "0.0000000000000000000001", "9007199254740993",
+                                          "179.9999999", "-84.0000001", "5.", ".5" };
+
+        for ( int i = 0; i < 20000; ++i ) {
+            std::ostringstream number;
+            number << std::fixed << std::setprecision( i % 10 ) << distribution( generator );
+            numbers.push_back( number.str() );
+        }
+
+        for ( const auto& number : numbers ) {
+            double value = 0.0;
+            REQUIRE( double_utilities::to_double( number.data(), number.size(), value ) );
+
+            double expected = std::strtod( number.c_str(), nullptr );
+            CHECK( std::memcmp( &value, &expected, sizeof( double ) ) == 0 );
+            CHECK( double_utilities::to_double( number ) == std::stod( number ) );
+        }
+    }
+
+    SECTION( "Not Numbers" ) {
+        double value = 1.0;
+        for ( const std::string number : { "", "-", ".", "1.2.3", "35.9x", "--1", "1e", "1e999" } ) {
+            CHECK_FALSE( double_utilities::to_double( number.data(), number.size(), value ) );
+        }
+        CHECK( value == 1.0 );
+
+        // the length bounds the number.
+        const char* buffer = "35.94911,-83.928343";
+        CHECK( double_utilities::to_double( buffer, 8, value ) );
+        CHECK( value == 35.94911 );
+
+        CHECK_THROWS_AS( double_utilities::to_double( std::string{ "x" } ), std::invalid_argument );
+        CHECK_THROWS_AS( double_utilities::to_double( std::string{ "1e999" } ), std::out_of_range );
+        CHECK( double_utilities::to_double( std::string{ " 35.5" } ) == 35.5 );
+        CHECK( double_utilities::to_double( std::string{ "35.5 mph" } ) == 35.5 );
+    }
+
+    SECTION( "Without The Locale" ) {
+        // a locale with a decimal comma; the test is only meaningful where one is installed.
+        std::string previous{ std::setlocale( LC_NUMERIC, nullptr ) };
+        for ( const char* name : { "de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "fr_FR.utf8" } ) {
+            if ( std::setlocale( LC_NUMERIC, name ) != nullptr ) break;
+        }
+
+        double value = 0.0;
+        CHECK( double_utilities::to_double( "7.55e-5", 7, value ) );
+        CHECK( value == 7.55e-5 );
+        CHECK( double_utilities::to_double( "0.30000000000000004", 19, value ) );
+        CHECK( value == 0.30000000000000004 );
+        CHECK_FALSE( double_utilities::to_double( "7,55e-5", 7, value ) );
+        CHECK( double_utilities::to_double( std::string{ " 1.5e3" } ) == 1500.0 );
+
+        std::setlocale( LC_NUMERIC, previous.c_str() );
+    }
+}
+
+TEST_CASE( "Decimal Conversion Benchmark", "[.][benchmark]" ) {
+    // hidden; run with: ppm_tests "[benchmark]"
+
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> distribution{ -180.0, 180.0 };
+    std::vector<std::string> numbers;
+
+    for ( int i = 0; i < 1000; ++i ) {
+        std::ostringstream number;
+        number << std::fixed << std::setprecision( 7 ) << distribution( generator );
+        numbers.push_back( number.str() );
+    }
+
+    const int iterations = 1000;
+    double stod_sum = 0.0;
+    double strtod_sum = 0.0;
+    double direct_sum = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < iterations; ++i ) {
+        for ( const auto& number : numbers ) stod_sum += std::stod( number );
+    }
+    auto stod_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < iterations; ++i ) {
+        for ( const auto& number : numbers ) strtod_sum += std::strtod( number.c_str(), nullptr );
+    }
+    auto strtod_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < iterations; ++i ) {
+        for ( const auto& number : numbers ) {
+            double value = 0.0;
+            double_utilities::to_double( number.data(), number.size(), value );
+            direct_sum += value;
+        }
+    }
+    auto direct_time = std::chrono::steady_clock::now() - start;
+
+    CHECK( direct_sum == stod_sum );
+    CHECK( direct_sum == strtod_sum );
+
+    double count = static_cast<double>( iterations ) * numbers.size();
+    double stod_ns = std::chrono::duration<double, std::nano>( stod_time ).count() / count;
+    double strtod_ns = std::chrono::duration<double, std::nano>( strtod_time ).count() / count;
+    double direct_ns = std::chrono::duration<double, std::nano>( direct_time ).count() / count;
+    std::cout << "Decimal conversion: std::stod " << stod_ns << " ns; strtod " << strtod_ns << " ns; to_double "
+              << direct_ns << " ns (" << strtod_ns / direct_ns << "x)" << std::endl;
+}
+
 TEST_CASE("Entity", "[quad][entity]") {
     SECTION("Conversions") {
         CHECK(geo::to_degrees(0.0) == Approx(0.0));
@@ -951,6 +1158,225 @@ TEST_CASE("Quad Tree", "[quad]") {
     }
 }
 
+TEST_CASE( "Frozen Quad Tree", "[quad][frozen]" ) {
+    // the frozen tree must return the same entities, in the same order, as the tree it was built from.
+
+    geo::Point sw{ 35.946920, -83.938486 };
+    geo::Point ne{ 35.955526, -83.926738 };
+    Quad::Ptr qptr = std::make_shared<Quad>( sw, ne );
+
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> latitude{ sw.lat, ne.lat };
+    std::uniform_real_distribution<double> longitude{ sw.lon, ne.lon };
+
+    // enough locations to split the tree several levels; a location near a split is stored in more than one leaf.
+    for ( uint64_t i = 0; i < 2000; ++i ) {
+        Quad::insert( qptr, std::make_shared<geo::Location>( latitude( generator ), longitude( generator ), i ) );
+    }
+
+    FrozenQuad frozen{ *qptr };
+    CHECK( frozen.node_count() == Quad::retrieve_all_bounds( qptr ).size() );
+    CHECK( frozen.entity_count() == 2000 );
+    CHECK( frozen.footprint() > 0 );
+
+    for ( int i = 0; i < 20000; ++i ) {
+        geo::Point pt{ latitude( generator ), longitude( generator ) };
+
+        const geo::Entity::PtrList& expected = qptr->retrieve_elements( pt );
+        FrozenQuad::ElementRange range = frozen.retrieve_elements( pt );
+        REQUIRE( range.size() == expected.size() );
+
+        bool same = true;
+        auto it = expected.begin();
+        for ( const geo::Entity& entity : range ) {
+            same = same && &entity == it->get();
+            ++it;
+        }
+        CHECK( same );
+    }
+
+    // outside the tree.
+    CHECK( frozen.retrieve_elements( geo::Point{ 90.0, 180.0 } ).empty() );
+
+    // later inserts are not seen by the frozen copy.
+    geo::Point center{ 35.951223, -83.932612 };
+    std::size_t before = frozen.retrieve_elements( center ).size();
+    Quad::insert( qptr, std::make_shared<geo::Location>( center.lat, center.lon, 2000 ) );
+    CHECK( frozen.retrieve_elements( center ).size() == before );
+
+    // the corridor blocks and the other entities together answer as the entities do one at a time.
+    const double corridor_extension = BSMHandler::kDefaultBoxExtension;
+    Quad::Ptr corridor_qptr = buildTestQuadTree( corridor_extension );
+    FrozenQuad corridor_frozen{ *corridor_qptr };
+    CHECK( corridor_frozen.corridor_extension() == corridor_extension );
+    CHECK( std::isnan( frozen.corridor_extension() ) );
+
+    std::size_t corridor_inside = 0;
+    for ( int i = 0; i < 20000; ++i ) {
+        geo::Point pt{ latitude( generator ), longitude( generator ) };
+        std::size_t leaf = corridor_frozen.locate( pt );
+        REQUIRE( leaf != FrozenQuad::npos );
+
+        bool expected = false;
+        std::size_t others = 0;
+        for ( const geo::Entity& entity : corridor_frozen.elements( leaf ) ) {
+            if ( entity.get_kind() == geo::EntityKind::CORRIDOR ) {
+                expected = expected || static_cast<const geo::Corridor&>( entity ).contains( pt );
+            } else {
+                ++others;
+            }
+        }
+
+        CHECK( corridor_frozen.corridors_contain( leaf, pt ) == expected );
+        CHECK( corridor_frozen.others( leaf ).size() == others );
+        if ( expected ) ++corridor_inside;
+    }
+    CHECK( corridor_inside > 0 );
+    CHECK_FALSE( corridor_frozen.corridors_contain( FrozenQuad::npos, center ) );
+
+    // a tree with no elements has a single empty leaf.
+    FrozenQuad empty{ Quad{ sw, ne } };
+    CHECK( empty.node_count() == 1 );
+    CHECK( empty.retrieve_elements( center ).empty() );
+}
+
+TEST_CASE( "Grid Index", "[index][grid]" ) {
+    // a handler with a grid index must answer as a handler with a quad tree.
+
+    CHECK_THROWS_AS( ( GridIndex{ kTestSW, kTestNE, 0.0, buildTestEntities() } ), std::invalid_argument );
+    CHECK_THROWS_AS( ( GridIndex{ kTestNE, kTestSW, 0.001, buildTestEntities() } ), std::invalid_argument );
+
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> latitude{ kTestSW.lat, kTestNE.lat };
+    std::uniform_real_distribution<double> longitude{ kTestSW.lon, kTestNE.lon };
+
+    for ( double corridor_extension : { 0.0, 10.0 } ) {
+        for ( const std::string extension : { "10.0", "25.0" } ) {
+            ConfigMap pconf;
+            REQUIRE( buildBaseConfiguration( pconf ) ); 
+            pconf["privacy.filter.geofence.extension"] = extension;
+
+            // cells from about 1 km down to about 110 meters.
+            for ( double cell_degrees : { 0.01, GridIndex::kDefaultCellDegrees, 0.001 } ) {
+                INFO( "corridors: " << corridor_extension << "; extension: " << extension << "; cell: " << cell_degrees );
+
+                auto grid = std::make_shared<const GridIndex>( kTestSW, kTestNE, cell_degrees, buildTestEntities( corridor_extension ) );
+                CHECK( std::string{ grid->name() } == "grid" );
+                CHECK( grid->cell_degrees() == cell_degrees );
+                CHECK( grid->entity_count() == 8 );
+
+                BSMHandler quad_handler{ buildTestQuadTree( corridor_extension ), pconf, testLogger };
+                BSMHandler grid_handler{ grid, pconf, testLogger };
+
+                int inside = 0;
+                bool same = true;
+                for ( int i = 0; i < 20000; ++i ) {
+                    BSM bsm;
+                    bsm.set_latitude( latitude( generator ) );
+                    bsm.set_longitude( longitude( generator ) );
+
+                    bool within = quad_handler.isWithinEntity( bsm );
+                    same = same && grid_handler.isWithinEntity( bsm ) == within;
+                    if ( within ) ++inside;
+                }
+
+                CHECK( same );
+                CHECK( inside > 0 );
+                CHECK( inside < 20000 );
+            }
+        }
+    }
+
+    // only the cells with entities are stored; points in the others, or outside the region, are in no cell.
+    geo::Point far_ne{ kTestNE.lat + 0.1, kTestNE.lon + 0.1 };
+    GridIndex grid{ kTestSW, far_ne, 0.001, buildTestEntities( 10.0 ) };
+    CHECK( grid.locate( geo::Point{ kTestNE.lat + 0.05, kTestNE.lon + 0.05 } ) == SpatialIndex::npos );
+    CHECK( grid.retrieve_elements( geo::Point{ kTestNE.lat + 0.05, kTestNE.lon + 0.05 } ).empty() );
+    CHECK( grid.locate( geo::Point{ 90.0, 180.0 } ) == SpatialIndex::npos );
+    CHECK_FALSE( grid.retrieve_elements( geo::Point{ 35.952500, -83.932434 } ).empty() );
+    CHECK( grid.cell_count() < 100 * 100 );
+    CHECK( grid.footprint() > 0 );
+
+}
+
+TEST_CASE( "Area Containment Kernels", "[cvlib][kernel]" ) {
+    // every kernel must give exactly the answers of Area::contains, including for blocks that are not a multiple of the
+    // vector width.
+
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> latitude{ 35.946920, 35.955526 };
+    std::uniform_real_distribution<double> longitude{ -83.938486, -83.926738 };
+    std::uniform_real_distribution<double> extension{ 5.0, 40.0 };
+
+    geo::kernel::AreaArrays arrays;
+    std::vector<std::vector<geo::AreaPtr>> blocks;
+    std::vector<std::size_t> firsts;
+
+    for ( std::size_t count = 0; count < 11; ++count ) {
+        firsts.push_back( arrays.size() );
+        blocks.emplace_back();
+
+        for ( std::size_t i = 0; i < count; ++i ) {
+            geo::Vertex::Ptr v1 = std::make_shared<geo::Vertex>( latitude( generator ), longitude( generator ), 2 * i );
+            geo::Vertex::Ptr v2 = std::make_shared<geo::Vertex>( latitude( generator ), longitude( generator ), 2 * i + 1 );
+            geo::Edge edge{ v1, v2, osm::Highway::SECONDARY, i };
+            blocks.back().push_back( edge.to_area( extension( generator ) ) );
+            arrays.add( *blocks.back().back() );
+        }
+
+        arrays.pad( firsts.back() );
+        CHECK( ( arrays.size() - firsts.back() ) % geo::kernel::AreaArrays::kLanes == 0 );
+    }
+
+    std::vector<geo::kernel::Isa> isas{ geo::kernel::Isa::SCALAR };
+    if ( geo::kernel::supported_isa() != geo::kernel::Isa::SCALAR ) {
+        isas.push_back( geo::kernel::supported_isa() );
+    }
+
+    // lat and lon also feed the many-point kernel; 2003 points leave a partial vector at the end.
+    std::vector<double> lat;
+    std::vector<double> lon;
+    for ( int i = 0; i < 2003; ++i ) {
+        lat.push_back( latitude( generator ) );
+        lon.push_back( longitude( generator ) );
+    }
+
+    std::size_t inside = 0;
+    for ( std::size_t b = 0; b < blocks.size(); ++b ) {
+        std::vector<bool> expected;
+        for ( std::size_t p = 0; p < lat.size(); ++p ) {
+            geo::Point pt{ lat[p], lon[p] };
+            bool contained = false;
+            for ( auto& area_ptr : blocks[b] ) {
+                contained = contained || area_ptr->contains( pt );
+            }
+            expected.push_back( contained );
+            if ( contained ) ++inside;
+        }
+
+        for ( geo::kernel::Isa isa : isas ) {
+            INFO( "kernel: " << geo::kernel::isa_name( isa ) << "; areas: " << blocks[b].size() );
+
+            bool same = true;
+            for ( std::size_t p = 0; p < lat.size(); ++p ) {
+                same = same && arrays.any_contains( firsts[b], blocks[b].size(), geo::Point{ lat[p], lon[p] }, isa ) == expected[p];
+            }
+            CHECK( same );
+
+            std::unique_ptr<bool[]> out{ new bool[ lat.size() ] };
+            arrays.any_contains( firsts[b], blocks[b].size(), lat.data(), lon.data(), lat.size(), out.get(), isa );
+            same = true;
+            for ( std::size_t p = 0; p < lat.size(); ++p ) {
+                same = same && out[p] == expected[p];
+            }
+            CHECK( same );
+        }
+    }
+
+    CHECK( inside > 0 );
+    CHECK( std::string{ geo::kernel::isa_name( geo::kernel::Isa::SCALAR ) } == "scalar" );
+}
+
 /** PPM tests below **/
 
 TEST_CASE( "Redactor Checks", "[ppm][redactor]" ) {
@@ -1142,7 +1568,7 @@ TEST_CASE( "BSMHandler Checks", "[ppm][handler]" ) {
 
     ConfigMap pconf;
     REQUIRE( buildBaseConfiguration( pconf ) ); 
-    BSMHandler handler{ nullptr, pconf, testLogger };
+    BSMHandler handler{ Quad::Ptr{}, pconf, testLogger };
 
     // FOR EACH SECTION THE TEST CASE IS EXECUTED FROM THE START.
 
@@ -1180,139 +1606,680 @@ TEST_CASE( "BSMHandler Checks", "[ppm][handler]" ) {
     }
 }
 
-TEST_CASE( "BSMHandler JSON Malformed Parsing", "[ppm][filtering][parsing]" ) {
+TEST_CASE( "BSMHandler Geofence Corridors", "[ppm][handler][geofence]" ) {
+    // the precomputed areas must give the same answers as the areas built for each BSM.
 
-    ConfigMap pconf;
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> latitude{ 35.946920, 35.955526 };
+    std::uniform_real_distribution<double> longitude{ -83.938486, -83.926738 };
 
-    REQUIRE( buildBaseConfiguration( pconf ) ); 
-    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+    for ( const std::string extension : { "10.0", "25.0" } ) {
+        ConfigMap pconf;
+        REQUIRE( buildBaseConfiguration( pconf ) ); 
+        pconf["privacy.filter.geofence.extension"] = extension;
 
-    std::vector<std::string> json_test_cases;
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.malformed.json", json_test_cases ) );
+        BSMHandler edge_handler{ buildTestQuadTree(), pconf, testLogger };
+        // built with the default extension; a handler with another extension rebuilds the areas.
+        BSMHandler corridor_handler{ buildTestQuadTree( BSMHandler::kDefaultBoxExtension ), pconf, testLogger };
 
-    for ( auto& test_case : json_test_cases ) {
-        CHECK_FALSE( handler.process( test_case ) );
-        CHECK( handler.get_result_string() == "parse" );
+        int inside = 0;
+        for ( int i = 0; i < 20000; ++i ) {
+            BSM bsm;
+            bsm.set_latitude( latitude( generator ) );
+            bsm.set_longitude( longitude( generator ) );
+
+            bool within = edge_handler.isWithinEntity( bsm );
+            CHECK( corridor_handler.isWithinEntity( bsm ) == within );
+            if ( within ) ++inside;
+        }
+
+        // both answers occur.
+        CHECK( inside > 0 );
+        CHECK( inside < 20000 );
     }
+
+    geo::Vertex::Ptr v_a = std::make_shared<geo::Vertex>(35.952500, -83.932434, 1);
+    geo::Vertex::Ptr v_b = std::make_shared<geo::Vertex>(35.948878, -83.928081, 2);
+    geo::EdgePtr edge = std::make_shared<geo::Edge>(v_a, v_b, osm::Highway::SECONDARY, 1);
+    geo::Corridor corridor{ edge, 10.0 };
+
+    CHECK( corridor.get_type() == "corridor" );
+    CHECK( corridor.get_extension() == 10.0 );
+    CHECK( corridor.get_edge() == edge );
+    CHECK( corridor.get_area().get_corners() == edge->to_area( 10.0 )->get_corners() );
+    CHECK( corridor.contains( *v_a ) );
+    CHECK_FALSE( corridor.contains( geo::Point{ 35.950715, -83.934971 } ) );
 }
 
-TEST_CASE( "BSMHandler JSON No Filtering", "[ppm][filtering][alloff]" ) {
-    // Should just flip the sanitized flag.
+TEST_CASE( "Entity Kinds", "[cvlib][entity]" ) {
+    // each entity reports the kind that matches its type string.
 
-    ConfigMap pconf;
+    geo::Vertex::Ptr v_a = std::make_shared<geo::Vertex>(35.952500, -83.932434, 1);
+    geo::Vertex::Ptr v_b = std::make_shared<geo::Vertex>(35.948878, -83.928081, 2);
+    geo::EdgePtr edge = std::make_shared<geo::Edge>(v_a, v_b, osm::Highway::SECONDARY, 1);
+
+    geo::Location location{ 35.951853, -83.932832 };
+    geo::Location ne{ 35.953642, -83.929975 };
+    geo::Corridor corridor{ edge, 10.0 };
+    geo::Circle circle{ 35.951250, -83.931861, 10.0 };
+    geo::Grid grid{ location, ne, 0, 0 };
+
+    CHECK( location.get_kind() == geo::EntityKind::LOCATION );
+    CHECK( edge->get_kind() == geo::EntityKind::EDGE );
+    CHECK( edge->to_area( 10.0 )->get_kind() == geo::EntityKind::AREA );
+    CHECK( corridor.get_kind() == geo::EntityKind::CORRIDOR );
+    CHECK( circle.get_kind() == geo::EntityKind::CIRCLE );
+    CHECK( grid.get_kind() == geo::EntityKind::GRID );
+
+    const geo::Entity& entity = corridor;
+    CHECK( entity.get_kind() == geo::EntityKind::CORRIDOR );
+}
 
-    REQUIRE( buildBaseConfiguration( pconf ) ); 
-    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+TEST_CASE( "Geofence Dispatch Benchmark", "[.][benchmark]" ) {
+    // hidden; run with: ppm_tests "[benchmark]"
 
-    handler.deactivate<BSMHandler::kVelocityFilterFlag>();
-    handler.deactivate<BSMHandler::kGeofenceFilterFlag>();
-    handler.deactivate<BSMHandler::kIdRedactFlag>();
-    handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+    std::vector<geo::Point> vertices;
+    Quad::Ptr qptr = buildI80QuadTree( BSMHandler::kDefaultBoxExtension, vertices );
+    if ( !qptr ) {
+        WARN( "map file not found: " CVDP_DATA_DIR "/I_80.edges" );
+        return;
+    }
 
-    REQUIRE_FALSE( handler.is_active<BSMHandler::kIdRedactFlag>() );
-    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeofenceFilterFlag>() );
-    REQUIRE_FALSE( handler.is_active<BSMHandler::kVelocityFilterFlag>() );
-    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeneralRedactFlag>() );
+    ConfigMap pconf;
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    // the corridors were built with the default extension; the handler must use the same one.
+    pconf["privacy.filter.geofence.extension"] = std::to_string( BSMHandler::kDefaultBoxExtension );
+    BSMHandler handler{ qptr, pconf, testLogger };
+    const double box_extension = BSMHandler::kDefaultBoxExtension;
+
+    // points scattered around the edge vertices: some on the road, some off it.
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> offset{ -0.0005, 0.0005 };
+    std::vector<BSM> bsms;
+    for ( std::size_t i = 0; i < 100000; ++i ) {
+        const geo::Point& v = vertices[ i % vertices.size() ];
+        BSM bsm;
+        bsm.set_latitude( v.lat + offset( generator ) );
+        bsm.set_longitude( v.lon + offset( generator ) );
+        bsms.push_back( bsm );
+    }
 
-    // load up all the test cases.
-    std::vector<std::string> json_test_cases;
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.id.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+    // the dispatch BSMHandler::isWithinEntity made before: compare the type strings, then cast the shared pointer.
+    auto string_dispatch = [&]( BSM& bsm ) {
+        for ( auto& entity_ptr : qptr->retrieve_elements( bsm ) ) {
+            if ( entity_ptr->get_type() == "corridor" ) {
+                geo::Corridor::CPtr corridor_ptr = std::static_pointer_cast<const geo::Corridor>( entity_ptr );
+                if ( corridor_ptr->get_extension() == box_extension ) {
+                    if ( corridor_ptr->contains( bsm ) ) return true;
+                } else if ( corridor_ptr->get_edge()->to_area( box_extension )->contains( bsm ) ) {
+                    return true;
+                }
+            } else if ( entity_ptr->get_type() == "edge" ) {
+                geo::EdgeCPtr edge_ptr = std::static_pointer_cast<const geo::Edge>( entity_ptr );
+                if ( edge_ptr->to_area( box_extension )->contains( bsm ) ) return true;
+            } else if ( entity_ptr->get_type() == "circle" ) {
+                if ( std::static_pointer_cast<const geo::Circle>( entity_ptr )->contains( bsm ) ) return true;
+            } else if ( entity_ptr->get_type() == "grid" ) {
+                if ( std::static_pointer_cast<const geo::Grid>( entity_ptr )->contains( bsm ) ) return true;
+            }
+        }
+        return false;
+    };
 
-    for ( auto& test_case : json_test_cases ) {
-        CHECK( handler.process( test_case ) );
-        // without any flag set, all JSON data files should pass through the PPM with the following modifications:
-        // 1. the santized field should be set.
-        // 2. the PPM process id should be added.
-        CHECK( handler.get_result_string() == "success" );
-        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    std::size_t string_inside = 0;
+    auto start = std::chrono::steady_clock::now();
+    for ( auto& bsm : bsms ) {
+        if ( string_dispatch( bsm ) ) ++string_inside;
     }
-}
-
-TEST_CASE( "BSMHandler JSON Full Filtering", "[ppm][filtering][allon]" ) {
+    auto string_time = std::chrono::steady_clock::now() - start;
 
-    ConfigMap pconf;
+    std::size_t kind_inside = 0;
+    start = std::chrono::steady_clock::now();
+    for ( auto& bsm : bsms ) {
+        if ( handler.isWithinEntity( bsm ) ) ++kind_inside;
+    }
+    auto kind_time = std::chrono::steady_clock::now() - start;
 
-    REQUIRE( buildBaseConfiguration( pconf ) ); 
-    // should redact everything independent of how the set is set.
-    pconf["privacy.redaction.id.inclusions"]    = "OFF";
+    CHECK( kind_inside == string_inside );
 
-    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+    double string_ns = std::chrono::duration<double, std::nano>( string_time ).count() / bsms.size();
+    double kind_ns = std::chrono::duration<double, std::nano>( kind_time ).count() / bsms.size();
+    std::cout << "I_80 geofence lookups (" << kind_inside << "/" << bsms.size() << " inside): string dispatch " << string_ns
+              << " ns/op; kind dispatch " << kind_ns << " ns/op (" << string_ns / kind_ns << "x)" << std::endl;
+}
 
-    // without any flag set, all JSON data files should pass through the PPM with the following modifications:
-    // 1. the santized field should be set.
-    // 2. the PPM process id should be added.
+TEST_CASE( "Quad Lookup Benchmark", "[.][benchmark]" ) {
+    // hidden; run with: ppm_tests "[benchmark]"
 
-    std::vector<std::string> json_test_cases;
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
-    for ( auto& test_case : json_test_cases ) {
-        CHECK( handler.process( test_case ) );
-        CHECK( handler.get_result_string() == "success" );
-        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
-        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    std::vector<geo::Point> vertices;
+    Quad::Ptr qptr = buildI80QuadTree( BSMHandler::kDefaultBoxExtension, vertices );
+    if ( !qptr ) {
+        WARN( "map file not found: " CVDP_DATA_DIR "/I_80.edges" );
+        return;
     }
 
-    // get rid of previous cases.
-    json_test_cases.clear();
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.id.json", json_test_cases ) );
-    for ( auto& test_case : json_test_cases ) {
-        CHECK( handler.process( test_case ) );
-        CHECK( handler.get_result_string() == "success" );
-        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
-        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    FrozenQuad frozen{ *qptr };
+
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> offset{ -0.0005, 0.0005 };
+    std::uniform_int_distribution<std::size_t> pick{ 0, vertices.size() - 1 };
+    std::vector<geo::Point> points;
+    for ( std::size_t i = 0; i < 1000000; ++i ) {
+        const geo::Point& v = vertices[ pick( generator ) ];
+        points.emplace_back( v.lat + offset( generator ), v.lon + offset( generator ) );
     }
 
-    // get rid of previous cases.
-    json_test_cases.clear();
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
-    for ( auto& test_case : json_test_cases ) {
-        CHECK_FALSE( handler.process( test_case ) );
-        CHECK( handler.get_result_string() == "speed" );
-        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
-        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    std::size_t quad_sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for ( auto& pt : points ) {
+        for ( auto& entity_ptr : qptr->retrieve_elements( pt ) ) {
+            quad_sum += reinterpret_cast<std::uintptr_t>( entity_ptr.get() );
+        }
     }
+    auto quad_time = std::chrono::steady_clock::now() - start;
 
-    // get rid of previous cases.
-    json_test_cases.clear();
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
-    for ( auto& test_case : json_test_cases ) {
-        CHECK_FALSE( handler.process( test_case ) );
-        CHECK( handler.get_result_string() == "geoposition" );
-        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
-        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    std::size_t frozen_sum = 0;
+    start = std::chrono::steady_clock::now();
+    for ( auto& pt : points ) {
+        for ( const geo::Entity& entity : frozen.retrieve_elements( pt ) ) {
+            frozen_sum += reinterpret_cast<std::uintptr_t>( &entity );
+        }
     }
+    auto frozen_time = std::chrono::steady_clock::now() - start;
+
+    CHECK( frozen_sum == quad_sum );
+
+    double quad_ns = std::chrono::duration<double, std::nano>( quad_time ).count() / points.size();
+    double frozen_ns = std::chrono::duration<double, std::nano>( frozen_time ).count() / points.size();
+    std::cout << "I_80 quad lookups (" << frozen.node_count() << " nodes, " << frozen.entity_count() << " entities, "
+              << frozen.footprint() << " bytes frozen): Quad " << quad_ns << " ns/op; FrozenQuad " << frozen_ns << " ns/op ("
+              << quad_ns / frozen_ns << "x)" << std::endl;
 }
 
-TEST_CASE( "BSMHandler JSON Id Redaction Only", "[ppm][filtering][idonly]" ) {
+TEST_CASE( "Corridor Kernel Benchmark", "[.][benchmark]" ) {
+    // hidden; run with: ppm_tests "[benchmark]"
 
-    ConfigMap pconf;
+    std::vector<geo::Point> vertices;
+    Quad::Ptr qptr = buildI80QuadTree( BSMHandler::kDefaultBoxExtension, vertices );
+    if ( !qptr ) {
+        WARN( "map file not found: " CVDP_DATA_DIR "/I_80.edges" );
+        return;
+    }
 
-    REQUIRE( buildBaseConfiguration( pconf ) ); 
-    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+    FrozenQuad scalar{ *qptr, geo::kernel::Isa::SCALAR };
+    FrozenQuad vector{ *qptr };
+
+    std::mt19937_64 generator{ 20170802 };
+    std::uniform_real_distribution<double> offset{ -0.0005, 0.0005 };
+    std::uniform_int_distribution<std::size_t> pick{ 0, vertices.size() - 1 };
+    std::vector<geo::Point> points;
+    std::vector<std::size_t> leaves;
+    for ( std::size_t i = 0; i < 1000000; ++i ) {
+        const geo::Point& v = vertices[ pick( generator ) ];
+        points.emplace_back( v.lat + offset( generator ), v.lon + offset( generator ) );
+        leaves.push_back( vector.locate( points.back() ) );
+    }
 
-    handler.deactivate<BSMHandler::kVelocityFilterFlag>();
-    handler.deactivate<BSMHandler::kGeofenceFilterFlag>();
-    //handler.activate<BSMHandler::kIdRedactFlag>();
-    handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+    // one point against the corridors of its leaf: one at a time, as before, and with each kernel.
+    auto start = std::chrono::steady_clock::now();
+    std::size_t entity_inside = 0;
+    for ( std::size_t i = 0; i < points.size(); ++i ) {
+        for ( const geo::Entity& entity : vector.elements( leaves[i] ) ) {
+            if ( entity.get_kind() == geo::EntityKind::CORRIDOR && static_cast<const geo::Corridor&>( entity ).contains( points[i] ) ) {
+                ++entity_inside;
+                break;
+            }
+        }
+    }
+    auto entity_time = std::chrono::steady_clock::now() - start;
 
-    REQUIRE( handler.is_active<BSMHandler::kIdRedactFlag>() );
-    REQUIRE_FALSE( handler.is_active<BSMHandler::kVelocityFilterFlag>() );
-    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeofenceFilterFlag>() );
-    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeneralRedactFlag>() );
+    start = std::chrono::steady_clock::now();
+    std::size_t scalar_inside = 0;
+    for ( std::size_t i = 0; i < points.size(); ++i ) {
+        if ( scalar.corridors_contain( leaves[i], points[i] ) ) ++scalar_inside;
+    }
+    auto scalar_time = std::chrono::steady_clock::now() - start;
 
-    std::vector<std::string> json_test_cases;
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
-    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
-    for ( auto& test_case : json_test_cases ) {
-        CHECK( handler.process( test_case ) );
-        CHECK( handler.get_result_string() == "success" );
-        CHECK( handler.get_bsm().get_id() == handler.get_bsm().get_original_id() );
+    start = std::chrono::steady_clock::now();
+    std::size_t vector_inside = 0;
+    for ( std::size_t i = 0; i < points.size(); ++i ) {
+        if ( vector.corridors_contain( leaves[i], points[i] ) ) ++vector_inside;
+    }
+    auto vector_time = std::chrono::steady_clock::now() - start;
+
+    CHECK( scalar_inside == entity_inside );
+    CHECK( vector_inside == entity_inside );
+
+    // many points against one leaf: the points of each leaf in one call.
+    std::vector<std::size_t> order( points.size() );
+    for ( std::size_t i = 0; i < order.size(); ++i ) order[i] = i;
+    std::sort( order.begin(), order.end(), [&]( std::size_t a, std::size_t b ) { return leaves[a] < leaves[b]; } );
+
+    std::vector<double> lat;
+    std::vector<double> lon;
+    for ( std::size_t i : order ) {
+        lat.push_back( points[i].lat );
+        lon.push_back( points[i].lon );
+    }
+
+    std::unique_ptr<bool[]> out{ new bool[ points.size() ] };
+    start = std::chrono::steady_clock::now();
+    for ( std::size_t first = 0; first < order.size(); ) {
+        std::size_t last = first;
+        while ( last < order.size() && leaves[ order[last] ] == leaves[ order[first] ] ) ++last;
+        vector.corridors_contain( leaves[ order[first] ], lat.data() + first, lon.data() + first, last - first, out.get() + first );
+        first = last;
+    }
+    auto batch_time = std::chrono::steady_clock::now() - start;
+
+    std::size_t batch_inside = 0;
+    for ( std::size_t i = 0; i < points.size(); ++i ) {
+        if ( out[i] ) ++batch_inside;
+    }
+    CHECK( batch_inside == entity_inside );
+
+    auto ns = [&]( std::chrono::steady_clock::duration d ) {
+        return std::chrono::duration<double, std::nano>( d ).count() / points.size();
+    };
+    std::cout << "I_80 corridor tests (" << entity_inside << "/" << points.size() << " inside): one at a time " << ns( entity_time )
+              << " ns/op; scalar kernel " << ns( scalar_time ) << " ns/op; " << geo::kernel::isa_name( vector.isa() ) << " kernel "
+              << ns( vector_time ) << " ns/op; " << geo::kernel::isa_name( vector.isa() ) << " by leaf " << ns( batch_time ) << " ns/op" << std::endl;
+}
+
+TEST_CASE( "Geofence Index Benchmark", "[.][benchmark]" ) {
+    // hidden; run with: ppm_tests "[benchmark]"
+
+    for ( const std::string mapname : { "I_80.edges", "plymouth_rd.quad" } ) {
+        geo::Point sw, ne;
+        std::vector<geo::Point> vertices;
+        geo::Entity::PtrList entities = loadMapEntities( mapname, BSMHandler::kDefaultBoxExtension, sw, ne, vertices );
+        if ( entities.empty() ) {
+            WARN( "map file not found: " << mapname );
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Quad::Ptr qptr = std::make_shared<Quad>( sw, ne );
+        for ( auto& entity_ptr : entities ) {
+            Quad::insert( qptr, entity_ptr );
+        }
+        auto quad = std::make_shared<const FrozenQuad>( *qptr );
+        double quad_build_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+        std::vector<std::pair<std::string, SpatialIndex::CPtr>> indexes{ { "quad", quad } };
+        std::vector<double> build_ms{ quad_build_ms };
+        for ( double cell_degrees : { 0.01, GridIndex::kDefaultCellDegrees, 0.002 } ) {
+            start = std::chrono::steady_clock::now();
+            auto grid = std::make_shared<const GridIndex>( sw, ne, cell_degrees, entities );
+            build_ms.push_back( std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() );
+            indexes.emplace_back( "grid " + std::to_string( cell_degrees ), grid );
+        }
+
+        // points scattered around the edge vertices: some on the road, some off it.
+        std::mt19937_64 generator{ 20170802 };
+        std::uniform_real_distribution<double> offset{ -0.0005, 0.0005 };
+        std::uniform_int_distribution<std::size_t> pick{ 0, vertices.size() - 1 };
+        std::vector<BSM> bsms;
+        for ( std::size_t i = 0; i < 500000; ++i ) {
+            const geo::Point& v = vertices[ pick( generator ) ];
+            BSM bsm;
+            bsm.set_latitude( v.lat + offset( generator ) );
+            bsm.set_longitude( v.lon + offset( generator ) );
+            bsms.push_back( bsm );
+        }
+
+        ConfigMap pconf;
+        REQUIRE( buildBaseConfiguration( pconf ) ); 
+        pconf["privacy.filter.geofence.extension"] = std::to_string( BSMHandler::kDefaultBoxExtension );
+
+        std::size_t expected = 0;
+        for ( std::size_t k = 0; k < indexes.size(); ++k ) {
+            BSMHandler handler{ indexes[k].second, pconf, testLogger };
+
+            std::size_t locate_sum = 0;
+            start = std::chrono::steady_clock::now();
+            for ( auto& bsm : bsms ) {
+                locate_sum += indexes[k].second->locate( bsm );
+            }
+            auto locate_time = std::chrono::steady_clock::now() - start;
+
+            std::size_t inside = 0;
+            start = std::chrono::steady_clock::now();
+            for ( auto& bsm : bsms ) {
+                if ( handler.isWithinEntity( bsm ) ) ++inside;
+            }
+            auto lookup_time = std::chrono::steady_clock::now() - start;
+
+            // the grid places corridors by their areas, so it finds the points near a wide road that the quad misses.
+            if ( k == 0 ) expected = inside;
+            CHECK( inside >= expected );
+            CHECK( locate_sum > 0 );
+
+            double locate_ns = std::chrono::duration<double, std::nano>( locate_time ).count() / bsms.size();
+            double lookup_ns = std::chrono::duration<double, std::nano>( lookup_time ).count() / bsms.size();
+            std::cout << mapname << " " << indexes[k].first << ": " << indexes[k].second->cell_count() << " cells, "
+                      << indexes[k].second->footprint() << " bytes, built in " << build_ms[k] << " ms; locate " << locate_ns
+                      << " ns/op; isWithinEntity " << lookup_ns << " ns/op (" << inside << "/" << bsms.size() << " inside)" << std::endl;
+        }
+    }
+}
+
+TEST_CASE( "BSMHandler Pipeline Selection", "[ppm][handler][pipeline]" ) {
+    // every activation change must switch to the DOM pipeline compiled for the new flags.
+
+    ConfigMap pconf;
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    pconf["privacy.redaction.id.inclusions"] = "OFF";
+    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+    handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+    handler.deactivate<BSMHandler::kIdRedactFlag>();
+    handler.deactivate<BSMHandler::kSizeRedactFlag>();
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+    const std::string& test_case = json_test_cases.front();
+
+    CHECK_FALSE( handler.process( test_case ) );
+    CHECK( handler.get_result_string() == "speed" );
+
+    handler.deactivate<BSMHandler::kVelocityFilterFlag>();
+    CHECK( handler.process( test_case ) );
+    CHECK( handler.get_json().find( R"("length":0)" ) == std::string::npos );
+
+    handler.activate<BSMHandler::kSizeRedactFlag>();
+    CHECK( handler.process( test_case ) );
+    CHECK( handler.get_json().find( R"("length":0)" ) != std::string::npos );
+    CHECK( handler.get_json().find( R"("width":0)" ) != std::string::npos );
+
+    handler.activate<BSMHandler::kIdRedactFlag>();
+    CHECK( handler.process( test_case ) );
+    CHECK( handler.get_bsm().get_original_id() != handler.get_bsm().get_id() );
+
+    handler.activate<BSMHandler::kVelocityFilterFlag>();
+    CHECK_FALSE( handler.process( test_case ) );
+    CHECK( handler.get_result_string() == "speed" );
+}
+
+TEST_CASE( "BSMHandler JSON View", "[ppm][handler][view]" ) {
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+
+    for ( const std::string mode : { "DOM", "STREAM", "PATCH" } ) {
+        ConfigMap pconf;
+        REQUIRE( buildBaseConfiguration( pconf ) ); 
+        pconf["privacy.parse.mode"] = mode;
+        BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+        for ( const auto& test_case : json_test_cases ) {
+            if ( !handler.process( test_case ) ) continue;
+
+            // the view is the output; the string is the same characters.
+            BSMHandler::JsonView view = handler.get_json_view();
+            REQUIRE( view.length > 0 );
+            CHECK( handler.get_bsm_buffer_size() == view.length );
+
+            std::string viewed{ view.data, view.length };
+            CHECK( handler.get_json() == viewed );
+            CHECK( handler.get_json_view().length == viewed.size() );
+            CHECK( std::string( handler.get_json_view().data, handler.get_json_view().length ) == viewed );
+        }
+
+        // a rejected BSM has no output.
+        CHECK_FALSE( handler.process( R"({"metadata":)" ) );
+        CHECK( handler.get_json_view().length == 0 );
+        CHECK( handler.get_json().empty() );
+    }
+}
+
+TEST_CASE( "BSMHandler Batch Processing", "[ppm][handler][batch]" ) {
+    // a batch must have the results and outputs of processing its BSMs one at a time.
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.malformed.json", json_test_cases ) );
+
+    std::vector<BSMHandler::MessageView> msgs;
+    for ( const auto& test_case : json_test_cases ) {
+        msgs.push_back( { test_case.data(), test_case.size() } );
+    }
+
+    for ( const std::string mode : { "DOM", "STREAM", "PATCH" } ) {
+        ConfigMap pconf;
+        REQUIRE( buildBaseConfiguration( pconf ) ); 
+        pconf["privacy.parse.mode"] = mode;
+        BSMHandler single_handler{ buildTestQuadTree(), pconf, testLogger };
+        BSMHandler batch_handler{ buildTestQuadTree(), pconf, testLogger };
+
+        // the redacted id is random; keep the outputs comparable.
+        single_handler.deactivate<BSMHandler::kIdRedactFlag>();
+        batch_handler.deactivate<BSMHandler::kIdRedactFlag>();
+        single_handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+        batch_handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+
+        BSMHandler::ResultSink sink;
+        std::size_t retained = batch_handler.process_batch( msgs.data(), msgs.size(), sink );
+        REQUIRE( sink.results.size() == msgs.size() );
+
+        std::size_t expected_retained = 0;
+        std::string expected_output;
+
+        for ( std::size_t i = 0; i < msgs.size(); ++i ) {
+            const auto& result = sink.results[i];
+            bool single_retained = single_handler.process( json_test_cases[i] );
+
+            CHECK( result.retained == single_retained );
+            CHECK( result.status == single_handler.get_result() );
+
+            if ( single_retained ) {
+                CHECK( sink.output.compare( result.offset, result.length, single_handler.get_json() ) == 0 );
+                expected_output += single_handler.get_json();
+                ++expected_retained;
+            }
+        }
+
+        CHECK( retained == expected_retained );
+        CHECK( retained > 0 );
+        CHECK( retained < msgs.size() );
+
+        // the retained outputs are contiguous.
+        CHECK( sink.output == expected_output );
+
+        // the sink is reused and the handler still processes single BSMs.
+        batch_handler.process_batch( msgs.data(), 1, sink );
+        REQUIRE( sink.results.size() == 1 );
+        CHECK( sink.output.size() == sink.results[0].length );
+        CHECK( batch_handler.process( json_test_cases.front() ) );
+        CHECK( batch_handler.get_json() == sink.output );
+    }
+}
+
+TEST_CASE( "BSMHandler Payload Types", "[ppm][handler][payload]" ) {
+
+    PayloadRegistry registry;
+    CHECK( registry.size() == 1 );
+    CHECK( registry.find( PayloadRegistry::kBsmPayloadType.data(), PayloadRegistry::kBsmPayloadType.size() ) == PayloadKind::BSM );
+    CHECK( registry.find( "us.dot.its.jpo.ode.model.OdeTimPayload", 38 ) == PayloadKind::UNSUPPORTED );
+    // a prefix of a registered type is not that type.
+    CHECK( registry.find( PayloadRegistry::kBsmPayloadType.data(), 10 ) == PayloadKind::UNSUPPORTED );
+
+    registry.add( "us.dot.its.jpo.ode.model.OdeTimPayload", PayloadKind::PASS_THROUGH );
+    registry.add( "us.dot.its.jpo.ode.model.OdeTimPayload", PayloadKind::PASS_THROUGH );
+    CHECK( registry.size() == 2 );
+    CHECK( registry.find( "us.dot.its.jpo.ode.model.OdeTimPayload", 38 ) == PayloadKind::PASS_THROUGH );
+
+    const std::string tim_json{ R"({"metadata":{"asn1":"0012","payloadType":"us.dot.its.jpo.ode.model.OdeTimPayload","sanitized":false},"payload":{"data":{"msgCnt":1,"dataFrames":[{"startYear":2017}]}}})" };
+    const std::string sanitized_json{ R"({"metadata":{"asn1":"","payloadType":"us.dot.its.jpo.ode.model.OdeTimPayload","sanitized":true},"payload":{"data":{"msgCnt":1,"dataFrames":[{"startYear":2017}]}}})" };
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+
+    for ( const std::string mode : { "DOM", "STREAM", "PATCH" } ) {
+        ConfigMap pconf;
+        REQUIRE( buildBaseConfiguration( pconf ) ); 
+        pconf["privacy.parse.mode"] = mode;
+        BSMHandler bsm_handler{ buildTestQuadTree(), pconf, testLogger };
+
+        pconf["privacy.payload.types"] = "us.dot.its.jpo.ode.model.OdeTimPayload, us.dot.its.jpo.ode.model.OdeSpatPayload";
+        BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+        CHECK( bsm_handler.get_payload_registry().size() == 1 );
+        CHECK( handler.get_payload_registry().size() == 3 );
+
+        // only BSMs by default.
+        CHECK_FALSE( bsm_handler.process( tim_json ) );
+        CHECK( bsm_handler.get_result_string() == "missing" );
+        CHECK( bsm_handler.get_payload_kind() == PayloadKind::UNSUPPORTED );
+
+        // a pass-through payload is sanitized but not filtered.
+        CHECK( handler.process( tim_json ) );
+        CHECK( handler.get_result_string() == "success" );
+        CHECK( handler.get_payload_kind() == PayloadKind::PASS_THROUGH );
+        CHECK( handler.get_json() == sanitized_json );
+
+        // BSMs are still filtered.
+        CHECK( handler.process( json_test_cases.front() ) );
+        CHECK( handler.get_payload_kind() == PayloadKind::BSM );
+    }
+}
+
+TEST_CASE( "BSMHandler JSON Malformed Parsing", "[ppm][filtering][parsing]" ) {
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.malformed.json", json_test_cases ) );
+
+    for ( auto& test_case : json_test_cases ) {
+        CHECK_FALSE( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "parse" );
+    }
+}
+
+TEST_CASE( "BSMHandler JSON No Filtering", "[ppm][filtering][alloff]" ) {
+    // Should just flip the sanitized flag.
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+    handler.deactivate<BSMHandler::kVelocityFilterFlag>();
+    handler.deactivate<BSMHandler::kGeofenceFilterFlag>();
+    handler.deactivate<BSMHandler::kIdRedactFlag>();
+    handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+
+    REQUIRE_FALSE( handler.is_active<BSMHandler::kIdRedactFlag>() );
+    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeofenceFilterFlag>() );
+    REQUIRE_FALSE( handler.is_active<BSMHandler::kVelocityFilterFlag>() );
+    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeneralRedactFlag>() );
+
+    // load up all the test cases.
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.id.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+
+    for ( auto& test_case : json_test_cases ) {
+        CHECK( handler.process( test_case ) );
+        // without any flag set, all JSON data files should pass through the PPM with the following modifications:
+        // 1. the santized field should be set.
+        // 2. the PPM process id should be added.
+        CHECK( handler.get_result_string() == "success" );
+        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    }
+}
+
+TEST_CASE( "BSMHandler JSON Full Filtering", "[ppm][filtering][allon]" ) {
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    // should redact everything independent of how the set is set.
+    pconf["privacy.redaction.id.inclusions"]    = "OFF";
+
+    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+    // without any flag set, all JSON data files should pass through the PPM with the following modifications:
+    // 1. the santized field should be set.
+    // 2. the PPM process id should be added.
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "success" );
+        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
+        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    }
+
+    // get rid of previous cases.
+    json_test_cases.clear();
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.id.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "success" );
+        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
+        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    }
+
+    // get rid of previous cases.
+    json_test_cases.clear();
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK_FALSE( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "speed" );
+        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
+        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    }
+
+    // get rid of previous cases.
+    json_test_cases.clear();
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK_FALSE( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "geoposition" );
+        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
+        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    }
+}
+
+TEST_CASE( "BSMHandler JSON Id Redaction Only", "[ppm][filtering][idonly]" ) {
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+    handler.deactivate<BSMHandler::kVelocityFilterFlag>();
+    handler.deactivate<BSMHandler::kGeofenceFilterFlag>();
+    //handler.activate<BSMHandler::kIdRedactFlag>();
+    handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+
+    REQUIRE( handler.is_active<BSMHandler::kIdRedactFlag>() );
+    REQUIRE_FALSE( handler.is_active<BSMHandler::kVelocityFilterFlag>() );
+    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeofenceFilterFlag>() );
+    REQUIRE_FALSE( handler.is_active<BSMHandler::kGeneralRedactFlag>() );
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "success" );
+        CHECK( handler.get_bsm().get_id() == handler.get_bsm().get_original_id() );
     }
 
     // get rid of previous cases.
@@ -1833,4 +2800,796 @@ TEST_CASE( "BSMHandler JSON General Redaction w/ All Flags", "[ppm][redaction][g
         CHECK( numMembersPresentAfterRedaction == 0 );
     }
 
-}
\ No newline at end of file
+}
+
+TEST_CASE( "SPSC Ring", "[ppm][workers][ring]" ) {
+
+    SpscRing<int> ring{ 3 };
+
+    SECTION( "Capacity Is A Power Of Two" ) {
+        CHECK( ring.capacity() == 4 );
+        CHECK( SpscRing<int>{ 1 }.capacity() == 1 );
+        CHECK( SpscRing<int>{ 1000 }.capacity() == 1024 );
+    }
+
+    SECTION( "First In First Out And Bounded" ) {
+        for ( int i = 0; i < 4; ++i ) {
+            CHECK( ring.try_push( int{ i } ) );
+        }
+        CHECK_FALSE( ring.try_push( 4 ) );
+        CHECK( ring.size() == 4 );
+
+        int item;
+        for ( int i = 0; i < 4; ++i ) {
+            REQUIRE( ring.try_pop( item ) );
+            CHECK( item == i );
+        }
+        CHECK_FALSE( ring.try_pop( item ) );
+        CHECK( ring.size() == 0 );
+    }
+
+    SECTION( "Failed Push Leaves The Item" ) {
+        SpscRing<std::string> strings{ 1 };
+        std::string first{ "first" }, second{ "second" };
+        CHECK( strings.try_push( std::move( first ) ) );
+        CHECK_FALSE( strings.try_push( std::move( second ) ) );
+        CHECK( second == "second" );
+    }
+
+    SECTION( "Producer And Consumer Threads" ) {
+        // the producer waits on the full ring until the consumer catches up; order is preserved.
+        const int count = 100000;
+        std::thread producer{ [&ring, count]{
+            unsigned attempts = 0;
+            for ( int i = 0; i < count; ++i ) {
+                while ( !ring.try_push( int{ i } ) ) ring_backoff( attempts );
+            }
+        } };
+
+        int item, expected = 0;
+        bool ordered = true;
+        unsigned attempts = 0;
+        while ( expected < count ) {
+            if ( ring.try_pop( item ) ) {
+                ordered = ordered && ( item == expected++ );
+            } else {
+                ring_backoff( attempts );
+            }
+        }
+        producer.join();
+
+        CHECK( ordered );
+        CHECK( ring.size() == 0 );
+    }
+}
+
+TEST_CASE( "BSMHandler Process Character Buffer", "[ppm][filtering][buffer]" ) {
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    BSMHandler string_handler{ buildTestQuadTree(), pconf, testLogger };
+    BSMHandler buffer_handler{ buildTestQuadTree(), pconf, testLogger };
+
+    // the redacted id is random; keep the outputs comparable.
+    string_handler.deactivate<BSMHandler::kIdRedactFlag>();
+    buffer_handler.deactivate<BSMHandler::kIdRedactFlag>();
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.malformed.json", json_test_cases ) );
+
+    for ( auto& test_case : json_test_cases ) {
+        // like a Kafka payload: not null terminated and followed by other bytes.
+        std::vector<char> payload{ test_case.begin(), test_case.end() };
+        payload.push_back( '}' );
+
+        CHECK( buffer_handler.process( payload.data(), test_case.size() ) == string_handler.process( test_case ) );
+        CHECK( buffer_handler.get_result_string() == string_handler.get_result_string() );
+        CHECK( buffer_handler.get_json() == string_handler.get_json() );
+    }
+}
+
+TEST_CASE( "BSMHandler Streaming Parse", "[ppm][filtering][stream]" ) {
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    pconf["privacy.redaction.size"] = "ON";
+    BSMHandler dom_handler{ buildTestQuadTree(), pconf, testLogger };
+
+    pconf["privacy.parse.mode"] = "STREAM";
+    BSMHandler stream_handler{ buildTestQuadTree(), pconf, testLogger };
+
+    REQUIRE_FALSE( dom_handler.is_active<BSMHandler::kStreamParseFlag>() );
+    REQUIRE( stream_handler.is_active<BSMHandler::kStreamParseFlag>() );
+
+    // the redacted id is random; keep the outputs comparable.
+    dom_handler.deactivate<BSMHandler::kIdRedactFlag>();
+    stream_handler.deactivate<BSMHandler::kIdRedactFlag>();
+    dom_handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+    stream_handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+
+    SECTION( "Same Results As The DOM" ) {
+        std::vector<std::string> json_test_cases;
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.id.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.malformed.json", json_test_cases ) );
+
+        for ( auto& test_case : json_test_cases ) {
+            bool retained = dom_handler.process( test_case );
+
+            CHECK( stream_handler.process( test_case ) == retained );
+            CHECK( stream_handler.get_result_string() == dom_handler.get_result_string() );
+
+            if ( retained ) {
+                CHECK( stream_handler.get_json() == dom_handler.get_json() );
+                CHECK( stream_handler.get_bsm().get_id() == dom_handler.get_bsm().get_id() );
+                CHECK( stream_handler.get_bsm().get_velocity() == dom_handler.get_bsm().get_velocity() );
+            }
+        }
+
+        json_test_cases.clear();
+        REQUIRE ( loadTestCases( "unit-test-data/error_cases.json", json_test_cases ) );
+
+        for ( auto& test_case : json_test_cases ) {
+            CHECK_FALSE( stream_handler.process( test_case ) );
+        }
+    }
+
+    SECTION( "Member Order And Rewritten Values" ) {
+        dom_handler.deactivate<BSMHandler::kGeofenceFilterFlag>();
+        stream_handler.deactivate<BSMHandler::kGeofenceFilterFlag>();
+
+        // payload before metadata, and values of unexpected types for the rewritten fields.
+        std::string bsm_json{ R"({"payload":{"data":{"coreData":{"speed":22.0,"size":{"width":{"cm":150},"length":250},"position":{"longitude":-83.928343,"latitude":35.94911},"id":"G1"}}},"metadata":{"asn1":{"bytes":"0012"},"payloadType":"us.dot.its.jpo.ode.model.OdeBsmPayload","sanitized":false}})" };
+
+        CHECK( dom_handler.process( bsm_json ) );
+        CHECK( stream_handler.process( bsm_json ) );
+        CHECK( stream_handler.get_json() == dom_handler.get_json() );
+        CHECK( stream_handler.get_json() == R"({"payload":{"data":{"coreData":{"speed":22.0,"size":{"width":0,"length":0},"position":{"longitude":-83.928343,"latitude":35.94911},"id":"G1"}}},"metadata":{"asn1":"","payloadType":"us.dot.its.jpo.ode.model.OdeBsmPayload","sanitized":true}})" );
+    }
+
+    SECTION( "Invalid BSMs" ) {
+        CHECK_FALSE( stream_handler.process( R"({"metadata":{"payloadType":"us.dot.its.jpo.ode.model.OdeBsmPayload","sanitized":false},"payload":{"data":{"coreData":{"id":"G1","position":{"latitude":35.94911,"longitude":-83.928343}}}}})" ) );
+        CHECK( stream_handler.get_result_string() == "missing" );
+
+        CHECK_FALSE( stream_handler.process( R"({"metadata":{"payloadType":"us.dot.its.jpo.ode.model.OdeTimPayload","sanitized":false}})" ) );
+        CHECK( stream_handler.get_result_string() == "missing" );
+
+        CHECK_FALSE( stream_handler.process( R"({"metadata":{"sanitized":"no"}})" ) );
+        CHECK( stream_handler.get_result_string() == "other" );
+
+        CHECK_FALSE( stream_handler.process( R"([{"metadata":{}}])" ) );
+        CHECK( stream_handler.get_result_string() == "parse" );
+    }
+
+    SECTION( "General Redaction Uses The DOM" ) {
+        stream_handler.activate<BSMHandler::kGeneralRedactFlag>();
+
+        std::vector<std::string> json_test_cases;
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+
+        dom_handler.activate<BSMHandler::kGeneralRedactFlag>();
+        CHECK( stream_handler.process( json_test_cases.front() ) == dom_handler.process( json_test_cases.front() ) );
+        CHECK( stream_handler.get_json() == dom_handler.get_json() );
+    }
+}
+
+TEST_CASE( "BSMHandler Patch Output", "[ppm][filtering][patch]" ) {
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    pconf["privacy.redaction.size"] = "ON";
+    pconf["privacy.redaction.id.inclusions"] = "OFF";
+    BSMHandler dom_handler{ buildTestQuadTree(), pconf, testLogger };
+
+    pconf["privacy.parse.mode"] = "PATCH";
+    BSMHandler patch_handler{ buildTestQuadTree(), pconf, testLogger };
+
+    REQUIRE( patch_handler.is_active<BSMHandler::kStreamParseFlag>() );
+    REQUIRE( patch_handler.is_active<BSMHandler::kPatchOutputFlag>() );
+
+    dom_handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+    patch_handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+
+    SECTION( "Same Documents As The DOM" ) {
+        // the redacted id is random; keep the outputs comparable.
+        dom_handler.deactivate<BSMHandler::kIdRedactFlag>();
+        patch_handler.deactivate<BSMHandler::kIdRedactFlag>();
+
+        std::vector<std::string> json_test_cases;
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.inside.geofence.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+        REQUIRE ( loadTestCases( "unit-test-data/test-case.malformed.json", json_test_cases ) );
+
+        for ( auto& test_case : json_test_cases ) {
+            bool retained = dom_handler.process( test_case );
+
+            CHECK( patch_handler.process( test_case ) == retained );
+            CHECK( patch_handler.get_result_string() == dom_handler.get_result_string() );
+
+            if ( retained ) {
+                // the formatting differs; the JSON does not.
+                rapidjson::Document dom_document, patch_document;
+                REQUIRE_FALSE( dom_document.Parse( dom_handler.get_json().c_str() ).HasParseError() );
+                REQUIRE_FALSE( patch_document.Parse( patch_handler.get_json().c_str() ).HasParseError() );
+                CHECK( patch_document == dom_document );
+                CHECK( validateSanitizedProperty( patch_handler.get_json() ) );
+            }
+        }
+    }
+
+    SECTION( "Only The Redacted Values Change" ) {
+        std::string bsm_json{ R"({ "metadata": { "asn1": { "bytes": "0012" }, "payloadType": "us.dot.its.jpo.ode.model.OdeBsmPayload", "sanitized" : false },)"
+                              R"( "payload": { "data": { "coreData": { "id": "G1", "position": { "latitude": 35.94911, "longitude": -83.928343 }, "size": { "length": 250, "width": [ 1, 2 ] }, "speed": 22.00 } } } })" };
+
+        REQUIRE( patch_handler.process( bsm_json ) );
+
+        std::string id = patch_handler.get_bsm().get_id();
+        REQUIRE( id != "G1" );
+
+        CHECK( patch_handler.get_json() == R"({ "metadata": { "asn1":"", "payloadType": "us.dot.its.jpo.ode.model.OdeBsmPayload", "sanitized":true },)"
+                                           R"( "payload": { "data": { "coreData": { "id":")" + id + R"(", "position": { "latitude": 35.94911, "longitude": -83.928343 }, "size": { "length":0, "width":0 }, "speed": 22.00 } } } })" );
+    }
+
+    SECTION( "Only The Checked Numbers Are Converted" ) {
+        std::string bsm_json{ R"({"metadata":{"payloadType":"us.dot.its.jpo.ode.model.OdeBsmPayload","sanitized":false},)"
+                              R"("payload":{"data":{"coreData":{"id":"B1","heading":1.50E2,"position":{"latitude":35.949110,"longitude":-8.3928343e1},"speed":2.21e1}}}})" };
+
+        REQUIRE( dom_handler.process( bsm_json ) );
+        REQUIRE( patch_handler.process( bsm_json ) );
+
+        CHECK( patch_handler.get_bsm().get_velocity() == dom_handler.get_bsm().get_velocity() );
+        CHECK( patch_handler.get_bsm().lat == dom_handler.get_bsm().lat );
+        CHECK( patch_handler.get_bsm().lon == dom_handler.get_bsm().lon );
+
+        // the other numbers are copied as they are.
+        CHECK( patch_handler.get_json().find( R"("heading":1.50E2)" ) != std::string::npos );
+
+        // a speed must be a double, as in the DOM.
+        std::string int_speed_json{ R"({"metadata":{"payloadType":"us.dot.its.jpo.ode.model.OdeBsmPayload","sanitized":false},)"
+                                    R"("payload":{"data":{"coreData":{"id":"B1","position":{"latitude":35.94911,"longitude":-83.928343},"speed":22}}}})" };
+
+        CHECK_FALSE( dom_handler.process( int_speed_json ) );
+        CHECK_FALSE( patch_handler.process( int_speed_json ) );
+        CHECK( patch_handler.get_result_string() == dom_handler.get_result_string() );
+    }
+}
+
+TEST_CASE( "BSMHandler JSON Fast Discard", "[ppm][filtering][discard]" ) {
+
+    ConfigMap pconf;
+
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    pconf["privacy.redaction.id.inclusions"] = "OFF";
+    pconf["privacy.filter.fast.discard"] = "ON";
+    BSMHandler handler{ buildTestQuadTree(), pconf, testLogger };
+
+    REQUIRE( handler.is_active<BSMHandler::kFastDiscardFlag>() );
+    handler.deactivate<BSMHandler::kGeneralRedactFlag>();
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK( handler.process( test_case ) );
+        CHECK( validateSanitizedProperty( handler.get_json() ) );
+    }
+
+    // suppressed BSMs are not written but are logged with a redacted id.
+
+    json_test_cases.clear();
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.bad.speed.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK_FALSE( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "speed" );
+        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
+        CHECK( handler.get_bsm_buffer_size() == 0 );
+    }
+
+    json_test_cases.clear();
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.outside.geofence.json", json_test_cases ) );
+    for ( auto& test_case : json_test_cases ) {
+        CHECK_FALSE( handler.process( test_case ) );
+        CHECK( handler.get_result_string() == "geoposition" );
+        CHECK( handler.get_bsm().get_id() != handler.get_bsm().get_original_id() );
+        CHECK( handler.get_bsm_buffer_size() == 0 );
+    }
+}
+
+TEST_CASE( "JSON Arena", "[ppm][filtering][arena]" ) {
+
+    // about 40 KB of values.
+    std::string json_array{ "[" };
+    for ( int i = 0; i < 1000; ++i ) {
+        json_array += std::string( i > 0 ? "," : "" ) + R"({"id":"BEA10000","speed":22.0})";
+    }
+    json_array += "]";
+
+    SECTION( "Handler Settings" ) {
+        // bad sizes are logged and replaced by the defaults; they never stop the handler from being built.
+        for ( const std::string size : { "x", "0", "99999999999999999999999", "8192" } ) {
+            for ( const std::string high_water : { "y", "0", "4096", "2097152" } ) {
+                ConfigMap pconf;
+                REQUIRE( buildBaseConfiguration( pconf ) );
+                pconf["privacy.parse.arena.size"] = size;
+                pconf["privacy.parse.arena.max"] = high_water;
+
+                std::unique_ptr<BSMHandler> handler;
+                CHECK_NOTHROW( handler.reset( new BSMHandler{ buildTestQuadTree(), pconf, testLogger } ) );
+                REQUIRE( handler );
+                CHECK_NOTHROW( handler->process( json_array ) );
+            }
+        }
+    }
+
+    SECTION( "Grows Until Documents Fit" ) {
+        JsonArena arena{ 4096, 1024 * 1024 };
+        CHECK( arena.size() == 4096 );
+
+        {
+            JsonArena::Document document{ &arena.values(), JsonArena::kStackCapacity, &arena.stack() };
+            REQUIRE_FALSE( document.Parse( json_array.c_str() ).HasParseError() );
+            CHECK( arena.values().Capacity() > arena.size() );
+        }
+
+        arena.reset();
+        CHECK( arena.size() > 4096 );
+        CHECK( arena.values().Size() == 0 );
+
+        std::size_t size = arena.size();
+        for ( int i = 0; i < 3; ++i ) {
+            {
+                JsonArena::Document document{ &arena.values(), JsonArena::kStackCapacity, &arena.stack() };
+                REQUIRE_FALSE( document.Parse( json_array.c_str() ).HasParseError() );
+                CHECK( document.Size() == 1000 );
+
+                // nothing spilled out of the buffer.
+                CHECK( arena.values().Capacity() <= arena.size() );
+            }
+
+            arena.reset();
+            CHECK( arena.size() == size );
+        }
+    }
+
+    SECTION( "High Water" ) {
+        JsonArena arena{ 4096, 8192 };
+
+        for ( int i = 0; i < 3; ++i ) {
+            {
+                JsonArena::Document document{ &arena.values(), JsonArena::kStackCapacity, &arena.stack() };
+                REQUIRE_FALSE( document.Parse( json_array.c_str() ).HasParseError() );
+            }
+
+            arena.reset();
+            CHECK( arena.size() <= 8192 );
+            CHECK( arena.values().Capacity() <= arena.size() );
+        }
+    }
+}
+
+TEST_CASE( "BSM Member Lookup Benchmark", "[.][benchmark]" ) {
+    // hidden; run with: ppm_tests "[benchmark]"
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/bsm.new.json", json_test_cases ) );
+
+    rapidjson::Document document;
+    REQUIRE_FALSE( document.Parse( json_test_cases.front().c_str() ).HasParseError() );
+
+    const int iterations = 1000000;
+    double lookup_sum = 0.0;
+    double resolve_sum = 0.0;
+
+    // the lookups BSMHandler::process made before: HasMember, then operator[], for each member on the path.
+    auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < iterations; ++i ) {
+        if ( !document.HasMember( "metadata" ) ) break;
+        rapidjson::Value& metadata = document["metadata"];
+        if ( !metadata.HasMember( "sanitized" ) || !metadata["sanitized"].IsBool() ) break;
+        if ( !metadata.HasMember( "payloadType" ) || !metadata["payloadType"].IsString() ) break;
+        if ( !document.HasMember( "payload" ) ) break;
+        rapidjson::Value& payload = document["payload"];
+        if ( !payload.HasMember( "data" ) ) break;
+        rapidjson::Value& data = payload["data"];
+        if ( !data.HasMember( "coreData" ) ) break;
+        rapidjson::Value& core_data = data["coreData"];
+        if ( !core_data.HasMember( "speed" ) || !core_data["speed"].IsNumber() ) break;
+        if ( !core_data.HasMember( "position" ) ) break;
+        rapidjson::Value& position = core_data["position"];
+        if ( !position.HasMember( "latitude" ) || !position.HasMember( "longitude" ) ) break;
+        if ( !core_data.HasMember( "id" ) || !core_data["id"].IsString() ) break;
+        if ( core_data.HasMember( "size" ) ) {
+            rapidjson::Value& size = core_data["size"];
+            if ( size.HasMember( "length" ) && size.HasMember( "width" ) ) {
+                lookup_sum += size["length"].GetDouble();
+            }
+        }
+
+        lookup_sum += core_data["speed"].GetDouble() + position["latitude"].GetDouble() + position["longitude"].GetDouble();
+    }
+    auto lookup_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < iterations; ++i ) {
+        BSMMembers members;
+        members.resolve( document );
+
+        if ( !members.sanitized || !members.payload_type || !members.speed || !members.latitude || !members.longitude || !members.id ) break;
+        if ( members.length && members.width ) {
+            resolve_sum += members.length->GetDouble();
+        }
+
+        resolve_sum += members.speed->GetDouble() + members.latitude->GetDouble() + members.longitude->GetDouble();
+    }
+    auto resolve_time = std::chrono::steady_clock::now() - start;
+
+    CHECK( resolve_sum == lookup_sum );
+
+    double lookup_ns = std::chrono::duration<double, std::nano>( lookup_time ).count() / iterations;
+    double resolve_ns = std::chrono::duration<double, std::nano>( resolve_time ).count() / iterations;
+    std::cout << "BSM member lookups: HasMember/operator[] " << lookup_ns << " ns; single walk " << resolve_ns << " ns ("
+              << lookup_ns / resolve_ns << "x)" << std::endl;
+}
+
+TEST_CASE( "Output Buffer Pool", "[ppm][producer][buffers]" ) {
+
+    BufferPool pool{ 2 };
+
+    BufferPool::Buffer* first = pool.acquire();
+    REQUIRE( first != nullptr );
+    CHECK( first->json.empty() );
+    CHECK( pool.outstanding() == 1 );
+
+    first->json.assign( 2048, 'x' );
+    std::size_t capacity = first->json.capacity();
+    pool.release( first );
+    CHECK( pool.outstanding() == 0 );
+    CHECK( pool.idle() == 1 );
+
+    // released buffers are reused empty but keep their storage.
+    BufferPool::Buffer* second = pool.acquire();
+    CHECK( second == first );
+    CHECK( second->json.empty() );
+    CHECK( second->json.capacity() == capacity );
+
+    // only max_idle buffers are kept.
+    BufferPool::Buffer* third = pool.acquire();
+    BufferPool::Buffer* fourth = pool.acquire();
+    CHECK( pool.outstanding() == 3 );
+    pool.release( second );
+    pool.release( third );
+    pool.release( fourth );
+    pool.release( nullptr );
+    CHECK( pool.outstanding() == 0 );
+    CHECK( pool.idle() == 2 );
+
+    // the handler hands its output over without copying it.
+    ConfigMap pconf;
+    REQUIRE( buildBaseConfiguration( pconf ) ); 
+    BSMHandler handler{ Quad::Ptr{}, pconf, testLogger };
+    handler.deactivate<BSMHandler::kGeofenceFilterFlag>();
+
+    std::vector<std::string> json_test_cases;
+    REQUIRE ( loadTestCases( "unit-test-data/test-case.all.good.json", json_test_cases ) );
+    REQUIRE( handler.process( json_test_cases.front() ) );
+
+    std::string expected = handler.get_json();
+    BufferPool::Buffer* buffer = pool.acquire();
+    handler.swap_json( buffer->json );
+    CHECK( buffer->json == expected );
+    CHECK( handler.get_bsm_buffer_size() == 0 );
+    pool.release( buffer );
+
+    // the output is copied straight from the handler's buffer when get_json was not called.
+    REQUIRE( handler.process( json_test_cases.front() ) );
+    buffer = pool.acquire();
+    handler.swap_json( buffer->json );
+    CHECK( buffer->json == expected );
+    CHECK( handler.get_json().empty() );
+    pool.release( buffer );
+}
+
+TEST_CASE( "Worker Dispatcher", "[ppm][workers][dispatch]" ) {
+
+    ConfigMap pconf;
+
+    CHECK( WorkerDispatcher::fnv1a( "", 0 ) == 0xcbf29ce484222325ULL );
+    CHECK( WorkerDispatcher::fnv1a( "a", 1 ) == 0xaf63dc4c8601ec8cULL );
+
+    std::string bsm = R"({"payload": {"data": {"coreData": {"accelSet": {"accelYaw": 0}, "id" : "31325433", "msgCnt": 1}}}})";
+    const char* id;
+    std::size_t id_len;
+
+    SECTION( "Vehicle Id Scan" ) {
+        REQUIRE( WorkerDispatcher::find_vehicle_id( bsm.data(), bsm.size(), id, id_len ) );
+        CHECK( std::string( id, id_len ) == "31325433" );
+
+        std::string no_id = R"({"payload": {"data": {"coreData": {"msgCnt": 1}}}})";
+        CHECK_FALSE( WorkerDispatcher::find_vehicle_id( no_id.data(), no_id.size(), id, id_len ) );
+
+        std::string truncated = R"({"payload": {"data": {"coreData": {"id": "3132)";
+        CHECK_FALSE( WorkerDispatcher::find_vehicle_id( truncated.data(), truncated.size(), id, id_len ) );
+        std::string escaped = R"({"payload": {"data": {"coreData": {"id": "3132\")";
+        CHECK_FALSE( WorkerDispatcher::find_vehicle_id( escaped.data(), escaped.size(), id, id_len ) );
+        CHECK_FALSE( WorkerDispatcher::find_vehicle_id( nullptr, 0, id, id_len ) );
+
+        // only the id of coreData itself; not a nested one, one in partII, or one in a string.
+        std::string nested = R"({"metadata": {"note": "\"coreData\": {\"id\": \"x\"}"}, "payload": {"data": {)"
+                             R"("partII": [{"id": "partII"}], "coreData": {"accelSet": {"id": "nested"}, "size": [{"id": 1}],)"
+                             R"( "msgCnt": 1, "id" : "31325433"}}}})";
+        REQUIRE( WorkerDispatcher::find_vehicle_id( nested.data(), nested.size(), id, id_len ) );
+        CHECK( std::string( id, id_len ) == "31325433" );
+
+        std::string nested_only = R"({"payload": {"data": {"coreData": {"accelSet": {"id": "nested"}, "msgCnt": 1}, "id": "x"}}})";
+        CHECK_FALSE( WorkerDispatcher::find_vehicle_id( nested_only.data(), nested_only.size(), id, id_len ) );
+    }
+
+    SECTION( "Partition Mode" ) {
+        WorkerDispatcher dispatcher{ pconf, 4 };
+        CHECK( dispatcher.get_mode() == WorkerDispatcher::PARTITION );
+        CHECK( dispatcher.route( 6, "key", 3, bsm.data(), bsm.size() ) == 2 );
+        CHECK( dispatcher.route( 1, nullptr, 0, bsm.data(), bsm.size() ) == 1 );
+    }
+
+    SECTION( "Key Mode" ) {
+        pconf["privacy.workers.dispatch"] = "key";
+        WorkerDispatcher dispatcher{ pconf, 4 };
+        CHECK( dispatcher.get_mode() == WorkerDispatcher::KEY );
+
+        // the same key or vehicle goes to the same worker whatever the partition.
+        CHECK( dispatcher.route( 0, "key", 3, nullptr, 0 ) == WorkerDispatcher::fnv1a( "key", 3 ) % 4 );
+        CHECK( dispatcher.route( 3, "key", 3, nullptr, 0 ) == dispatcher.route( 0, "key", 3, nullptr, 0 ) );
+        CHECK( dispatcher.route( 2, nullptr, 0, bsm.data(), bsm.size() ) == WorkerDispatcher::fnv1a( "31325433", 8 ) % 4 );
+
+        // a vehicle is routed by its id whether or not the message has a key.
+        for ( const char* key : { "key", "another key", "31325433" } ) {
+            CHECK( dispatcher.route( 1, key, std::strlen( key ), bsm.data(), bsm.size() ) == dispatcher.route( 2, nullptr, 0, bsm.data(), bsm.size() ) );
+        }
+
+        // without a key or an id the partition is used.
+        CHECK( dispatcher.route( 3, nullptr, 0, "{}", 2 ) == 3 );
+    }
+
+    SECTION( "Single Worker" ) {
+        pconf["privacy.workers.dispatch"] = "key";
+        WorkerDispatcher dispatcher{ pconf, 1 };
+        CHECK( dispatcher.route( 5, "key", 3, bsm.data(), bsm.size() ) == 0 );
+    }
+}
+
+/**
+ * @brief A consumed message or event for the batch filler tests.
+ */
+struct FakeMessage {
+    RdKafka::ErrorCode code;
+    RdKafka::ErrorCode err() const { return code; }
+};
+
+/**
+ * @brief A consumer that returns the queued messages at once and then waits out the timeout, like librdkafka.
+ */
+struct FakeConsumer {
+    std::vector<RdKafka::ErrorCode> queued;
+    std::vector<int> timeouts;
+
+    std::unique_ptr<FakeMessage> operator()( int timeout ) {
+        timeouts.push_back( timeout );
+
+        if ( timeouts.size() <= queued.size() ) {
+            return std::unique_ptr<FakeMessage>{ new FakeMessage{ queued[ timeouts.size() - 1 ] } };
+        }
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( timeout ) );
+        return std::unique_ptr<FakeMessage>{ new FakeMessage{ RdKafka::ERR__TIMED_OUT } };
+    }
+};
+
+TEST_CASE( "Batch Filler", "[ppm][workers][batch]" ) {
+
+    FakeConsumer consumer;
+    std::vector<std::unique_ptr<FakeMessage>> batch;
+    std::vector<RdKafka::ErrorCode> events;
+    bool running = true;
+
+    auto fill = [&]( const BatchFiller& filler ) {
+        return filler.fill( std::ref( consumer ),
+                            [&]( std::unique_ptr<FakeMessage> msg ) { batch.push_back( std::move( msg ) ); },
+                            [&]( FakeMessage* msg ) { events.push_back( msg->err() ); },
+                            running );
+    };
+
+    SECTION( "Full Batch Is Dispatched At Once" ) {
+        consumer.queued.assign( 10, RdKafka::ERR_NO_ERROR );
+        BatchFiller filler{ 4, 60000, 500 };
+
+        auto start = std::chrono::steady_clock::now();
+        CHECK( fill( filler ) == 4 );
+        CHECK( std::chrono::steady_clock::now() - start < std::chrono::milliseconds( 1000 ) );
+
+        CHECK( batch.size() == 4 );
+        CHECK( consumer.timeouts.size() == 4 );
+        CHECK( events.empty() );
+
+        // the rest of the queued messages start the next batch.
+        CHECK( fill( filler ) == 4 );
+        CHECK( batch.size() == 8 );
+    }
+
+    SECTION( "Partial Batch Is Flushed At The Linger Timeout" ) {
+        consumer.queued.assign( 3, RdKafka::ERR_NO_ERROR );
+        BatchFiller filler{ 100, 50, 500 };
+
+        auto start = std::chrono::steady_clock::now();
+        CHECK( fill( filler ) == 3 );
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        CHECK( elapsed >= std::chrono::milliseconds( 40 ) );
+        CHECK( elapsed < std::chrono::milliseconds( 500 ) );
+        CHECK( batch.size() == 3 );
+
+        // the first message waits up to the consumer timeout; the others only until the linger deadline.
+        REQUIRE( consumer.timeouts.size() >= 4 );
+        CHECK( consumer.timeouts[0] == 500 );
+        for ( std::size_t i = 1; i < consumer.timeouts.size(); ++i ) {
+            CHECK( consumer.timeouts[i] <= 50 );
+        }
+
+        // the timeout that closes a partial batch is not an event.
+        CHECK( events.empty() );
+    }
+
+    SECTION( "No Linger Takes Only The Fetched Messages" ) {
+        consumer.queued.assign( 2, RdKafka::ERR_NO_ERROR );
+        BatchFiller filler{ 100, 0, 500 };
+
+        CHECK( fill( filler ) == 2 );
+        CHECK( consumer.timeouts.size() <= 3 );
+        CHECK( events.empty() );
+    }
+
+    SECTION( "Empty Batch Reports The Timeout" ) {
+        BatchFiller filler{ 100, 50, 10 };
+
+        CHECK( fill( filler ) == 0 );
+        CHECK( batch.empty() );
+        REQUIRE( events.size() == 1 );
+        CHECK( events[0] == RdKafka::ERR__TIMED_OUT );
+    }
+
+    SECTION( "EOF Or An Error Ends A Batch Early" ) {
+        consumer.queued = { RdKafka::ERR_NO_ERROR, RdKafka::ERR_NO_ERROR, RdKafka::ERR__PARTITION_EOF,
+                            RdKafka::ERR_NO_ERROR, RdKafka::ERR__TRANSPORT, RdKafka::ERR_NO_ERROR };
+        BatchFiller filler{ 100, 60000, 500 };
+
+        CHECK( fill( filler ) == 2 );
+        REQUIRE( events.size() == 1 );
+        CHECK( events[0] == RdKafka::ERR__PARTITION_EOF );
+
+        CHECK( fill( filler ) == 1 );
+        REQUIRE( events.size() == 2 );
+        CHECK( events[1] == RdKafka::ERR__TRANSPORT );
+        CHECK( batch.size() == 3 );
+    }
+
+    SECTION( "Stops When The Input Ends" ) {
+        consumer.queued.assign( 10, RdKafka::ERR_NO_ERROR );
+        BatchFiller filler{ 100, 60000, 500 };
+
+        // e.g., the status handler saw the last partition EOF.
+        running = false;
+        CHECK( fill( filler ) == 0 );
+        CHECK( consumer.timeouts.empty() );
+    }
+}
+
+TEST_CASE( "Offset Tracker", "[ppm][offsets]" ) {
+
+    OffsetTracker tracker;
+
+    SECTION( "Commit Only The Contiguous Completed Offsets" ) {
+        for ( int64_t offset = 10; offset < 15; ++offset ) {
+            tracker.consumed( 0, offset );
+        }
+        CHECK( tracker.pending() == 5 );
+        CHECK( tracker.take_commits().empty() );
+
+        // out of order completions hold the commit back until the gap fills.
+        tracker.completed( 0, 11 );
+        tracker.completed( 0, 12 );
+        CHECK( tracker.take_commits().empty() );
+
+        tracker.completed( 0, 10 );
+        OffsetTracker::CommitList commits = tracker.take_commits();
+        REQUIRE( commits.size() == 1 );
+        CHECK( commits[0] == OffsetTracker::Commit( 0, 13 ) );
+        CHECK( tracker.pending() == 2 );
+
+        // nothing new to commit.
+        CHECK( tracker.take_commits().empty() );
+
+        // an offset that is never completed (failed delivery) blocks everything after it.
+        tracker.completed( 0, 14 );
+        CHECK( tracker.take_commits().empty() );
+        CHECK( tracker.pending() == 2 );
+    }
+
+    SECTION( "Partitions And Gaps" ) {
+        tracker.consumed( 0, 5 );
+        tracker.consumed( 1, 100 );
+        tracker.consumed( 1, 103 );          // compacted offsets are not contiguous.
+        tracker.consumed( 0, 6 );
+
+        tracker.completed( 1, 103 );
+        tracker.completed( 1, 100 );
+        tracker.completed( 0, 5 );
+        tracker.completed( 2, 1 );           // never consumed; ignored.
+        tracker.completed( 1, 101 );         // never consumed; ignored.
+
+        OffsetTracker::CommitList commits = tracker.take_commits();
+        REQUIRE( commits.size() == 2 );
+        CHECK( commits[0] == OffsetTracker::Commit( 0, 6 ) );
+        CHECK( commits[1] == OffsetTracker::Commit( 1, 104 ) );
+        CHECK( tracker.pending() == 1 );
+
+        tracker.erase( 0 );
+        CHECK( tracker.pending() == 0 );
+        tracker.completed( 0, 6 );
+        CHECK( tracker.take_commits().empty() );
+    }
+
+    SECTION( "Clear" ) {
+        tracker.consumed( 0, 1 );
+        tracker.consumed( 1, 1 );
+        tracker.clear();
+        CHECK( tracker.pending() == 0 );
+        tracker.completed( 0, 1 );
+        CHECK( tracker.take_commits().empty() );
+    }
+
+    SECTION( "Failed Delivery Rewinds Instead Of Pinning" ) {
+        for ( int64_t offset = 10; offset < 15; ++offset ) {
+            tracker.consumed( 0, offset );
+        }
+
+        tracker.failed( 0, 99 );             // never consumed; ignored.
+        CHECK_FALSE( tracker.rewind_needed() );
+
+        // 12 failed: the commit stops before it and a rewind is requested.
+        tracker.completed( 0, 10 );
+        tracker.completed( 0, 11 );
+        tracker.failed( 0, 12 );
+        tracker.completed( 0, 13 );
+        tracker.completed( 0, 14 );
+        CHECK( tracker.rewind_needed() );
+
+        OffsetTracker::CommitList commits = tracker.take_commits();
+        REQUIRE( commits.size() == 1 );
+        CHECK( commits[0] == OffsetTracker::Commit( 0, 12 ) );
+        CHECK( tracker.pending() == 3 );
+
+        // the consumer restarts from the committed offset; the failed BSM and those after it are consumed again.
+        tracker.clear();
+        CHECK_FALSE( tracker.rewind_needed() );
+        CHECK( tracker.pending() == 0 );
+
+        for ( int64_t offset = 12; offset < 16; ++offset ) {
+            tracker.consumed( 0, offset );
+            tracker.completed( 0, offset );
+        }
+
+        commits = tracker.take_commits();
+        REQUIRE( commits.size() == 1 );
+        CHECK( commits[0] == OffsetTracker::Commit( 0, 16 ) );
+        CHECK( tracker.pending() == 0 );
+    }
+}
@@ -0,0 +1,146 @@
+#include "workerDispatcher.hpp"
+
+#include <cstring>
+
+namespace {
+
+const char* skip_space( const char* p, const char* end ) {
+    while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' ) ) ++p;
+    return p;
+}
+
+/**
+ * @brief Return a pointer just past the closing quote of the string that opens at p, or nullptr if it is not closed.
+ */
+const char* skip_string( const char* p, const char* end ) {
+    for ( ++p; p < end; ++p ) {
+        if ( *p == '\\' ) {
+            ++p;
+        } else if ( *p == '"' ) {
+            return p + 1;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief Return true if the string token [begin,end), quotes included, is the given text.
+ */
+bool is_text( const char* begin, const char* end, const char* text ) {
+    std::size_t len = std::strlen( text );
+    return static_cast<std::size_t>( end - begin ) == len + 2 && std::memcmp( begin + 1, text, len ) == 0;
+}
+
+/**
+ * @brief Find the member with the given key in [p,end); when key_only is false any depth, otherwise only the members
+ * of the object that p is in.
+ *
+ * @return a pointer to the first character of the member's value, or end if there is no such member.
+ */
+const char* find_member( const char* p, const char* end, const char* key, bool key_only ) {
+    int depth = 0;
+
+    while ( p < end ) {
+        switch ( *p ) {
+            case '{':
+            case '[':
+                ++depth;
+                ++p;
+                break;
+
+            case '}':
+            case ']':
+                // the end of the object being searched.
+                if ( key_only && --depth < 0 ) return end;
+                ++p;
+                break;
+
+            case '"': {
+                const char* token = p;
+                p = skip_string( p, end );
+                if ( !p ) return end;
+
+                const char* value = skip_space( p, end );
+
+                // a string followed by a colon is a member's key; any other string is a value.
+                if ( value < end && *value == ':' ) {
+                    if ( ( !key_only || depth == 0 ) && is_text( token, p, key ) ) return skip_space( value + 1, end );
+                    p = value + 1;
+                }
+                break;
+            }
+
+            default:
+                ++p;
+                break;
+        }
+    }
+
+    return end;
+}
+
+}
+
+WorkerDispatcher::WorkerDispatcher( const ConfigMap& conf, std::size_t workers ) :
+    mode_{ PARTITION },
+    workers_{ workers > 0 ? workers : 1 }
+{
+    auto search = conf.find("privacy.workers.dispatch");
+    if ( search != conf.end() && search->second == "key" ) {
+        mode_ = KEY;
+    }
+}
+
+WorkerDispatcher::DispatchMode WorkerDispatcher::get_mode() const {
+    return mode_;
+}
+
+std::size_t WorkerDispatcher::route( int32_t partition, const void* key, std::size_t key_len, const char* payload, std::size_t len ) const {
+    if ( workers_ == 1 ) return 0;
+
+    if ( mode_ == KEY ) {
+        // the vehicle id comes first, so a vehicle goes to one worker whether or not its messages have a key.
+        const char* id;
+        std::size_t id_len;
+        if ( find_vehicle_id( payload, len, id, id_len ) ) {
+            return fnv1a( id, id_len ) % workers_;
+        }
+
+        if ( key && key_len > 0 ) {
+            return fnv1a( static_cast<const char*>( key ), key_len ) % workers_;
+        }
+    }
+
+    return static_cast<std::size_t>( partition < 0 ? 0 : partition ) % workers_;
+}
+
+uint64_t WorkerDispatcher::fnv1a( const char* data, std::size_t len ) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for ( std::size_t i = 0; i < len; ++i ) {
+        hash ^= static_cast<unsigned char>( data[i] );
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+bool WorkerDispatcher::find_vehicle_id( const char* payload, std::size_t len, const char*& id, std::size_t& id_len ) {
+    if ( !payload ) return false;
+
+    const char* end = payload + len;
+    const char* p = find_member( payload, end, "coreData", false );
+    if ( p == end || *p != '{' ) return false;
+
+    // only a member of coreData itself; the objects nested in it, and partII, may have id members of their own.
+    p = find_member( p + 1, end, "id", true );
+    if ( p == end || *p != '"' ) return false;
+
+    const char* value_end = skip_string( p, end );
+    if ( !value_end ) return false;
+
+    id = p + 1;
+    id_len = static_cast<std::size_t>( value_end - p - 2 );
+    return true;
+}